@@ -6,6 +6,7 @@
 #include <linux/types.h>
 
 #include "qdma_desc.h"
+#include "qdma_ring.h"
 #include "econet_eth_regs.h"
 
 struct en75_debug;
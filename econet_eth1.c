@@ -16,9 +16,22 @@
 #include <linux/if_vlan.h>
 #include <linux/reset.h>
 #include <linux/tcp.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
 #include <linux/interrupt.h>
 #include <linux/pinctrl/devinfo.h>
 #include <linux/platform_device.h>
+#include <linux/dim.h>
+#include <linux/jhash.h>
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <linux/filter.h>
+#include <net/page_pool/helpers.h>
+#include <net/xdp.h>
+#include <net/xdp_sock_drv.h>
+#include <net/dsa.h>
+#include <net/dst_metadata.h>
+#include <net/pkt_sched.h>
 
 ///
 
@@ -30,43 +43,83 @@
 
 ///
 #define GDMA1_BASE			0x0500
+#define GDMA1_FWD_CFG			(GDMA1_BASE + 0x00)
+/* Parse the switch special tag into the descriptor sp_tag rather than
+ * leaving it in the packet, same bit as MediaTek's GDMA_IG_CTRL.
+ */
+#define GDMA1_FWD_SPECIAL_TAG		BIT(24)
+/* Unicast, multicast, broadcast and unknown packets all go through the
+ * PPE (ETX_FPORT_PPE) rather than straight to the CPU.
+ */
+#define GDMA1_FWD_TO_PPE		0x4444
 #define GDMA1_MAC_ADRL			(GDMA1_BASE + 0x08)
 #define GDMA1_MAC_ADRH			(GDMA1_BASE + 0x0c)
+/* Frames longer than the long length are dropped, from the vendor driver */
+#define GDMA1_LEN_CFG			(GDMA1_BASE + 0x14)
+#define GDMA_LONG_LEN_MASK		GENMASK(29, 16)
 #define GSW_BASE			0x8000
 #define GSW_MAC_BASE			(GSW_BASE + 0x3000)
+/* Same layout as MT7530_GMACCR */
+#define GSW_GMACCR			(GSW_MAC_BASE + 0xe0)
+#define GSW_MAX_RX_JUMBO_MASK		GENMASK(5, 2)
+#define GSW_MAX_RX_PKT_LEN_MASK		GENMASK(1, 0)
+#define GSW_MAX_RX_PKT_LEN_1522		0
+#define GSW_MAX_RX_PKT_LEN_1536		1
+#define GSW_MAX_RX_PKT_LEN_1552		2
+#define GSW_MAX_RX_PKT_LEN_JUMBO	3
 #define GSW_SMACCR0			(GSW_MAC_BASE + 0xe4)
 #define GSW_SMACCR1			(GSW_MAC_BASE + 0xe8)
 
-#define MTK_QDMA_INT_STATUS		0x4050
-#define MTK_QDMA_INT_MASK		0x4054
-// MTK_QDMA_INT_MASK bits.
+/* MT7530 special tag as written by the DSA mtk tagger */
+#define MTK_HDR_LEN			4
+#define MTK_HDR_XMIT_TAGGED_TPID_8100	1
+#define MTK_HDR_XMIT_TAGGED_TPID_88A8	2
+#define MTK_HDR_RECV_SOURCE_PORT_MASK	GENMASK(2, 0)
+
+/* TX completions are never latency sensitive so hold them back a bit */
+#define MTK_TX_COAL_USECS		20
+#define MTK_TX_COAL_FRAMES		16
+/* The Done List is polled no more often than this, even without coalescing */
+#define MTK_TX_TIMER_MIN_USECS		10
+// qregs int_status and int_mask bits.
 #define INT_STATUS_HWFWD_DSCP_LOW	BIT(10)
 #define INT_STATUS_IRQ_FULL		BIT(9)
 #define INT_STATUS_HWFWD_DSCP_EMPTY	BIT(8)
+/* The chain 1 bits are assumed to follow the chain 0 bits, the vendor
+ * driver only ever uses chain 0.
+ */
+#define INT_STATUS_NO_RX1_CPU_DSCP	BIT(7)
+#define INT_STATUS_NO_TX1_CPU_DSCP	BIT(6)
+#define INT_STATUS_RX1_DONE		BIT(5)
+#define INT_STATUS_TX1_DONE		BIT(4)
 #define INT_STATUS_NO_RX0_CPU_DSCP      BIT(3)
 #define INT_STATUS_NO_TX0_CPU_DSCP	BIT(2)
 #define INT_STATUS_RX0_DONE		BIT(1)
 #define INT_STATUS_TX0_DONE		BIT(0)
-
-#define QDMA_CSR_HWFWD_DSCP_BASE	0x4020
-#define QDMA_CSR_HWFWD_BUFF_BASE	0x4024
-#define QDMA_CSR_HWFWD_DSCP_CFG		0x4028
-#define QDMA_CSR_LMGR_INIT_CFG		0x4030
+/* What each NAPI poll handles, everything else in the mask is only
+ * acknowledged and goes with RX. TX0_DONE stays masked, see qdma_config(),
+ * the TX poll is driven by a timer and by a full Done List.
+ */
+#define INT_STATUS_RX_NAPI		(INT_STATUS_RX0_DONE | \
+					 INT_STATUS_RX1_DONE)
+#define INT_STATUS_TX_NAPI		INT_STATUS_IRQ_FULL
 
 #define QDMA_CSR_LMGR_START_BIT		BIT(31)
 
-
-#define QDMA_CSR_IRQ_STATUS		0x406C
-#define QDMA_CSR_IRQ_CLEAR_LEN		0x4068
 #define IRQ_STATUS_HEAD_IDX_MASK	0xFFF
 #define IRQ_STATUS_ENTRY_LEN_SHIFT	16
 #define IRQ_STATUS_ENTRY_LEN_MASK	(0xFFF << IRQ_STATUS_ENTRY_LEN_SHIFT)
 #define IRQ_DEF_VALUE			0xFFFFFFFF
+/* At most this many entries can be cleared with one CLEAR_LEN write */
+#define IRQ_CLEAR_LEN_MAX		0x7F
+/* Done List entry, index of the TX descriptor which was sent and the
+ * chain it belongs to. Where the chain is kept is assumed, the vendor
+ * driver only ever transmits on chain 0.
+ */
+#define IRQ_ENTRY_DESC_IDX_MASK		GENMASK(11, 0)
+#define IRQ_ENTRY_CHAIN			BIT(12)
 
-
-#define QDMA_CSR_IRQ_BASE		0x4060
-#define QDMA_CSR_IRQ_CFG		0x4064
-#define QDMA_IRQ_QUEUE_DEPTH		20
+#define QDMA_IRQ_QUEUE_DEPTH		256
 
 
 static int mtk_msg_level = -1;
@@ -155,19 +208,20 @@ static int mtk_mdio_read(struct mii_bus *bus, int phy_addr, int phy_reg)
 	return _mtk_mdio_read(eth, phy_addr, phy_reg);
 }
 
-static int UNUSED mtk_mdio_init(struct mtk_eth *eth)
+/* The mdio-bus node is optional, without it the switch stays in open
+ * forwarding mode.
+ */
+static int mtk_mdio_init(struct mtk_eth *eth)
 {
 	struct device_node *mii_np;
 	int ret;
 
 	mii_np = of_get_child_by_name(eth->dev->of_node, "mdio-bus");
-	if (!mii_np) {
-		dev_err(eth->dev, "no %s child node found", "mdio-bus");
-		return -ENODEV;
-	}
+	if (!mii_np)
+		return 0;
 
 	if (!of_device_is_available(mii_np)) {
-		ret = -ENODEV;
+		ret = 0;
 		goto err_put_node;
 	}
 
@@ -185,6 +239,8 @@ static int UNUSED mtk_mdio_init(struct mtk_eth *eth)
 
 	snprintf(eth->mii_bus->id, MII_BUS_ID_SIZE, "%pOFn", mii_np);
 	ret = of_mdiobus_register(eth->mii_bus, mii_np);
+	if (ret)
+		eth->mii_bus = NULL;
 
 err_put_node:
 	of_node_put(mii_np);
@@ -196,7 +252,7 @@ static void mtk_mdio_cleanup(struct mtk_eth *eth)
 	if (!eth->mii_bus)
 		return;
 
-	// mdiobus_unregister(eth->mii_bus);
+	mdiobus_unregister(eth->mii_bus);
 }
 
 static void en75_set_mac_hw(struct net_device *dev)
@@ -238,589 +294,2313 @@ static int en75_set_mac_address(struct net_device *dev, void *p)
 }
 
 #define QDMA_HWFWD_DESC_SIZE	16
+#define QDMA_HWFWD_BUFF_SIZE	2048
+/* The hardware forwarding payload size is QDMA_HWFWD_BUFF_SIZE << n, n is
+ * assumed to be bits 29..28 of hwfwd_dscp_cfg, the vendor driver only ever
+ * writes 0 there.
+ */
+#define HWFWD_PAYLOAD_SIZE_SHIFT	28
+#define HWFWD_PAYLOAD_SIZE_MAX		3
 
-#define TX0_DSCP_NUM	4
-#define RX0_DSCP_NUM	4
-#define DSCP_NUM	(TX0_DSCP_NUM + RX0_DSCP_NUM)
+/* Ring sizes must be powers of two, next_idx allows up to 4096. TX always
+ * goes out on chain 0, chain 1 only gets a small TX ring of its own.
+ */
+#define TX0_DSCP_NUM	512
+#define RX0_DSCP_NUM	256
+#define TX1_DSCP_NUM	64
+#define RX1_DSCP_NUM	128
 #define HWFWD_DSCP_NUM	8
 
-static void *hw_fwd_ary = NULL;
-static void *hw_fwd_buff = NULL;
+/* The chain which carries everything sent from the stack */
+#define QDMA_TX_CHAIN	0
+/* The chain which an AF_XDP socket can take over, it is RX queue 1 */
+#define QDMA_XSK_CHAIN	1
 
-static struct qdma_desc *dscp_ary = NULL;
-static struct sk_buff *dscp_sk_buff_p_ary[DSCP_NUM];
-
-static u32 *irq_queue = NULL;
+static const u16 qdma_tx_ring_size[NUM_QDMA_CHAINS] = {
+	TX0_DSCP_NUM, TX1_DSCP_NUM
+};
+static const u16 qdma_rx_ring_size[NUM_QDMA_CHAINS] = {
+	RX0_DSCP_NUM, RX1_DSCP_NUM
+};
 
-#define QDMA_CSR_TX_DSCP_BASE	0x4008
-#define QDMA_CSR_RX_DSCP_BASE	0x400C
-#define QDMA_CSR_RX_RING_CFG	0x4100
-#define QDMA_CSR_RX_RING_THR	0x4104
+/* Wake the queue once this many TX descriptors are free again */
+#define TX0_WAKE_THRESH	(TX0_DSCP_NUM / 4)
+/* Worst case number of descriptors for one skb, the head and every frag */
+#define TX0_DESC_NEEDED	(MAX_SKB_FRAGS + 1)
+/* No one TX queue may hold more than this many descriptors so that a
+ * congested queue always leaves room for the others.
+ */
+#define TXQ_DESC_MAX	(TX0_DSCP_NUM / 2)
+#define TXQ_WAKE_THRESH	(TXQ_DESC_MAX / 2)
 
-#define QDMA_CSR_TX_CPU_IDX	0x4010
-#define QDMA_CSR_TX_DMA_IDX	0x4014
+/* RX buffers are page_pool fragments, the hardware writes after the
+ * headroom and build_skb() puts the shared info at the end. Up to a
+ * standard MTU a buffer is half a page, see qdma_rx_buf_size(). With an
+ * XDP program the headroom is what XDP expects to be able to grow into.
+ *
+ * Where unaligned loads are slow the engine writes each packet 2 bytes past
+ * the address in the descriptor (QCFG_RX_2B_OFFSET), so the IP header is 4
+ * byte aligned. The headroom counts those 2 bytes.
+ */
+#define MTK_RX_BUF_SIZE_MIN	(PAGE_SIZE / 2)
+#define MTK_RX_IP_ALIGN		(NET_IP_ALIGN ? 2 : 0)
+#define MTK_RX_HEADROOM		(NET_SKB_PAD + MTK_RX_IP_ALIGN)
+#define MTK_RX_HEADROOM_XDP	(XDP_PACKET_HEADROOM + MTK_RX_IP_ALIGN)
+
+struct mtk_rx_buf {
+	void *data;
+	dma_addr_t dma;
+	/* Instead of data when the chain belongs to AF_XDP */
+	struct xdp_buff *xsk;
+};
 
-#define QDMA_CSR_RX_CPU_IDX	0x4018
-#define QDMA_CSR_RX_DMA_IDX	0x401C
+enum mtk_tx_buf_type {
+	MTK_TX_BUF_SKB = 0,
+	/* An RX buffer sent back out by XDP_TX, the page_pool mapped it */
+	MTK_TX_BUF_XDP_TX,
+	/* A frame from ndo_xdp_xmit, mapped here */
+	MTK_TX_BUF_XDP_NDO,
+	/* A frame from an AF_XDP TX ring, the xsk pool mapped it */
+	MTK_TX_BUF_XSK,
+};
 
-#define QDMA_CSR_GLB_CFG	0x4004
+/* What a TX descriptor points at, the skb is only kept with the last
+ * descriptor of a packet so it is freed after all of its fragments.
+ */
+struct mtk_tx_buf {
+	union {
+		struct sk_buff *skb;
+		struct xdp_frame *xdpf;
+	};
+	dma_addr_t dma;
+	u16 len;
+	bool is_frag;
+	u8 type;
+};
 
 /* #define DEBUG 1 */
 /* #define TX_DEBUG 1 */
 /* #define RX_DEBUG 1 */
 
-static void tx0_free_skb(struct mtk_eth *eth, int idx, struct qdma_desc *dscp)
-{
-	struct sk_buff *skb;
-	
-	skb = dscp_sk_buff_p_ary[idx];
-	dscp_sk_buff_p_ary[idx] = NULL;
-	dma_map_single(eth->dev,
-		       (void *)dscp->pkt_addr, skb_headlen(skb), DMA_FROM_DEVICE);
-	dev_kfree_skb(skb);	
-}
+#define qdma_w32(qdma, val, reg)	__raw_writel((val), &(qdma)->regs->reg)
+#define qdma_r32(qdma, reg)		__raw_readl(&(qdma)->regs->reg)
+#define qchain_w32(ch, val, reg)	__raw_writel((val), &(ch)->regs->reg)
+#define qchain_r32(ch, reg)		__raw_readl(&(ch)->regs->reg)
 
-static void tx0_free_some(struct mtk_eth *eth, struct qdma_desc *dscp)
+static struct qdma *mtk_mac_qdma(struct mtk_mac *mac)
 {
-	int i, idx;
-	
-	for (i = 0; i < 2; i++) {
-		idx = get_desc_next_idx(dscp);
-		dscp = &dscp_ary[idx];
-		if (dscp->pkt_addr) {
-			tx0_free_skb(eth, idx, dscp);
-			dscp->pkt_addr = 0;
-		}
-		/* TODO: If done = 0, adjust drop counter. */
-		
-		/* Set done = 0. */
-		set_desc_done(dscp, 0);
-		// memset(&dscp->ctrl, 0, sizeof(uint));
-	}
+	return &mac->hw->qdma[mac->id];
 }
 
-static int tx0_dscp_pkt_addr(struct mtk_eth *eth,
-			     struct sk_buff *skb, int idx)
+static struct net_device *qdma_netdev(struct qdma *qdma)
 {
-	dma_addr_t phys;
-	
-	phys = dma_map_single(eth->dev,
-			      skb->data, skb_headlen(skb), DMA_TO_DEVICE);
-	if (!phys) {
-		return 0;
-	}
-	dscp_sk_buff_p_ary[idx] = skb;
-	
-	return phys;
+	return qdma->eth->netdev[qdma->id];
 }
 
-static struct qdma_desc *tx0_get_dscp(int idx)
-{
-	return &dscp_ary[idx];
-}	
-
-static int mtk_tx_map(struct sk_buff *skb, struct net_device *dev)
+static void mtk_irq_disable(struct qdma *qdma, u32 mask)
 {
-	struct mtk_mac *mac = netdev_priv(dev);
-	struct mtk_eth *eth = mac->hw;
-	struct qdma_desc_etx *tx_msg;
-	struct qdma_desc *dscp;
-	int idx; //, val;
-
-#ifdef TX_DEBUG
-	print_dscp_ary(eth);
-	print_hw_fwd_ary(eth);
-#endif
-	
-	idx = mtk_r32(eth, QDMA_CSR_TX_CPU_IDX) % TX0_DSCP_NUM;
-#ifdef TX_DEBUG
-	printk("(1) CPU idx %d, DMA idx %d.",
-	       idx, mtk_r32(eth, QDMA_CSR_TX_DMA_IDX));
-#endif		
-	dscp = tx0_get_dscp(idx);
-
-	tx_msg = &dscp->t.etx;
-	set_etx_fport(tx_msg, 1); /* GDM_P_GDMA1 */
-
-	if (skb->len < 60) {
-		skb_padto(skb, 60);
-		skb_put(skb, 60 - skb->len);
-	}
-	
-	dscp->pkt_addr = tx0_dscp_pkt_addr(eth, skb, idx);
-	if (! dscp->pkt_addr) {
-		/* free skb. */
-		return -1;
-	}
-	dscp->pkt_len = skb_headlen(skb);
-	// dscp->ctrl.done = 0;
+	unsigned long flags;
+	u32 val;
 
-	/* QDMA_CSR_DMA_IDX will move to an element with
-	   done = 0. If element is not found, `done` marking will stop.
-
-	   Will become very busy, GLB_CFG_TX_DMA_BUSY, if it will not find 
-	   a packet for sending. */
-
-	/* TODO: We already freed some dscp's, no need to call this
-	   everytime.
-	   if (idx % 2) tx0_free_some(dscp); */
-	tx0_free_some(eth, dscp);
-	
-	// wmb();
-	
-	mtk_w32(eth, get_desc_next_idx(dscp), QDMA_CSR_TX_CPU_IDX);
-
-#ifdef TX_DEBIG
-	printk("(2) CPU idx %d, DMA idx %d, next_idx %d.",
-	       mtk_r32(eth, QDMA_CSR_TX_CPU_IDX),
-	       mtk_r32(eth, QDMA_CSR_TX_DMA_IDX),
-	       dscp->next_idx);
-#endif	
-	return 0;
+	spin_lock_irqsave(&qdma->irq_lock, flags);
+	val = qdma_r32(qdma, int_mask);
+	qdma_w32(qdma, val & ~mask, int_mask);
+	spin_unlock_irqrestore(&qdma->irq_lock, flags);
 }
 
-
-static netdev_tx_t mtk_start_xmit(struct sk_buff *skb, struct net_device *dev)
+static void mtk_irq_enable(struct qdma *qdma, u32 mask)
 {
-	struct mtk_mac *mac = netdev_priv(dev);
-	struct mtk_eth *eth = mac->hw;
-	struct net_device_stats *stats = &dev->stats;
-	
-	/* normally we can rely on the stack not calling this more than once,
-	 * however we have 2 queues running on the same ring so we need to lock
-	 * the ring access
-	 */
-	spin_lock(&eth->page_lock);
-
-	if (unlikely(test_bit(MTK_RESETTING, &eth->state)))
-		goto drop;
-
-
-	if (mtk_tx_map(skb, dev) < 0)
-		goto drop;
-
-	spin_unlock(&eth->page_lock);
-
-	return NETDEV_TX_OK;
+	unsigned long flags;
+	u32 val;
 
-drop:
-	spin_unlock(&eth->page_lock);
-	stats->tx_dropped++;
-	dev_kfree_skb_any(skb);
-	return NETDEV_TX_OK;
+	spin_lock_irqsave(&qdma->irq_lock, flags);
+	val = qdma_r32(qdma, int_mask);
+	qdma_w32(qdma, val | mask, int_mask);
+	spin_unlock_irqrestore(&qdma->irq_lock, flags);
 }
 
-static void mtk_dma_free(struct mtk_eth *eth)
+/* When the TX ring fills every queue of the MAC stops */
+static void mtk_tx_stop_queues(struct qdma *qdma)
 {
-	int i;
-
-	for (i = 0; i < MTK_MAC_COUNT; i++)
-		if (eth->netdev[i])
-			netdev_reset_queue(eth->netdev[i]);
+	netif_tx_stop_all_queues(qdma_netdev(qdma));
 }
 
-static void mtk_tx_timeout(struct net_device *dev, unsigned int txqueue)
+/* Wake every stopped queue which is back under its own limit, called with
+ * tx_lock held.
+ */
+static void mtk_tx_wake_queues(struct qdma *qdma)
 {
+	struct net_device *dev = qdma_netdev(qdma);
 	struct mtk_mac *mac = netdev_priv(dev);
-	struct mtk_eth *eth = mac->hw;
-
-	eth->netdev[mac->id]->stats.tx_errors++;
-	netif_err(eth, tx_err, dev,
-		  "transmit timed out\n");
-	schedule_work(&eth->pending_work);
-}
-
-static struct qdma_desc *rx0_get_dscp(int idx) {
-	return &dscp_ary[TX0_DSCP_NUM + idx];
+	struct netdev_queue *txq;
+	int q;
+
+	for (q = 0; q < dev->real_num_tx_queues; q++) {
+		txq = netdev_get_tx_queue(dev, q);
+		if (netif_tx_queue_stopped(txq) &&
+		    mac->tx_inflight[q] <= TXQ_WAKE_THRESH)
+			netif_tx_wake_queue(txq);
+	}
 }
 
-static struct sk_buff *rx0_new_skb(struct mtk_eth *eth,
-				   int idx, struct qdma_desc *dscp)
+/* Every writer of the per CPU counters runs in softirq context, xmit, the
+ * NAPI polls and the TX watchdog, so there is only ever one per CPU and
+ * nothing on the hot path takes a lock.
+ */
+static void mtk_stats_rx(struct mtk_mac *mac, u32 pkts, u32 bytes, u32 drops)
 {
-	int len;
-	struct sk_buff *new_skb;
-	dma_addr_t phys;
+	struct mtk_pcpu_stats *stats = this_cpu_ptr(mac->stats);
 
-	len = 2000;
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_add(&stats->rx_packets, pkts);
+	u64_stats_add(&stats->rx_bytes, bytes);
+	u64_stats_add(&stats->rx_dropped, drops);
+	u64_stats_update_end(&stats->syncp);
+}
 
-	new_skb = alloc_skb(len, GFP_ATOMIC);
-	if (!new_skb) {
-		return NULL;
-	}
+static void mtk_stats_tx(struct mtk_mac *mac, u32 pkts, u32 bytes)
+{
+	struct mtk_pcpu_stats *stats = this_cpu_ptr(mac->stats);
 
-	phys = dma_map_single(eth->dev, new_skb->data, len, DMA_TO_DEVICE);
-	if (!phys) {
-		// free new_skb.
-		return NULL;
-	}
-	dscp_sk_buff_p_ary[TX0_DSCP_NUM + idx] = new_skb;
-	dscp->pkt_addr = phys;
-	
-	return new_skb;
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_add(&stats->tx_packets, pkts);
+	u64_stats_add(&stats->tx_bytes, bytes);
+	u64_stats_update_end(&stats->syncp);
 }
 
-static struct sk_buff *rx0_pop_skb(struct mtk_eth *eth,
-				   int idx, struct qdma_desc *dscp)
+static void mtk_stats_tx_drop(struct mtk_mac *mac)
 {
-	int len;
-	struct sk_buff *skb;
-	dma_addr_t phys;
+	struct mtk_pcpu_stats *stats = this_cpu_ptr(mac->stats);
 
-	len = 2000;
-	
-	skb = dscp_sk_buff_p_ary[idx + TX0_DSCP_NUM];
-	phys = dscp->pkt_addr;
-	if (rx0_new_skb(eth, idx, dscp)) {
-		dma_unmap_single(eth->dev, phys, len, DMA_FROM_DEVICE);
-		return skb;
-	} 
-	return NULL;
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_inc(&stats->tx_dropped);
+	u64_stats_update_end(&stats->syncp);
 }
 
-static void rx0_dscp_defaults(struct qdma_desc *dscp)
+/* Completed packets and bytes per queue, for BQL */
+struct mtk_tx_done {
+	unsigned int pkts[MTK_QDMA_TX_QUEUES];
+	unsigned int bytes[MTK_QDMA_TX_QUEUES];
+	/* XDP and AF_XDP frames don't belong to any TX queue */
+	unsigned int xdp_pkts;
+	unsigned int xdp_bytes;
+	unsigned int xsk_frames;
+};
+
+static void qdma_tx_unmap_buf(struct mtk_eth *eth, struct mtk_tx_buf *buf)
 {
-	/* TODO: May be this is not necessary. The is payload size. */
-	dscp->pkt_len = 1518;
+	if (!buf->len)
+		return;
+	/* The page_pool keeps XDP_TX buffers mapped */
+	if (buf->type == MTK_TX_BUF_XDP_TX) {
+		buf->len = 0;
+		return;
+	}
+	if (buf->is_frag)
+		dma_unmap_page(eth->dev, buf->dma, buf->len, DMA_TO_DEVICE);
+	else
+		dma_unmap_single(eth->dev, buf->dma, buf->len, DMA_TO_DEVICE);
+	buf->len = 0;
 }
 
-static void rx0_done(struct mtk_eth *eth)
+/* Unmap a slot and free its skb if it has one, if done is not NULL then
+ * the skb is counted there.
+ */
+static void qdma_tx_free_buf(struct qdma_chain *ch, int idx, int budget,
+			     struct mtk_tx_done *done)
 {
-	int idx, val;
-	struct qdma_desc *dscp;
+	struct mtk_tx_buf *buf = &ch->tx_bufs[idx];
 	struct sk_buff *skb;
-	
-	val = mtk_r32(eth, QDMA_CSR_RX_DMA_IDX);
-#ifdef RX_DEBUG	
-	printk("rx0_done (1) CPU = %d, DMA = %d.",
-	       mtk_r32(eth, QDMA_CSR_RX_CPU_IDX), val);
-#endif
-	/* Get previous ring index. */
-	idx = (val + (RX0_DSCP_NUM - 1)) % RX0_DSCP_NUM;
-
-	dscp = rx0_get_dscp(idx);
-	skb = rx0_pop_skb(eth, idx, dscp);	
-	if (skb) {
-		skb_put(skb, dscp->pkt_len);
-		/* TODO: Get netdev by switch port. How? */
-		skb->protocol = eth_type_trans(skb, eth->netdev[0]);
-		netif_rx(skb);
-	} else {
-		/* TODO: Update netdev drop counter. */
+
+	if (buf->type == MTK_TX_BUF_XSK) {
+		if (done) {
+			done->xsk_frames++;
+			done->xdp_pkts++;
+			done->xdp_bytes += buf->len;
+		}
+		buf->len = 0;
+		buf->type = MTK_TX_BUF_SKB;
+		return;
 	}
-	rx0_dscp_defaults(dscp);
-	set_desc_done(dscp, false);
-	/* DMA ID will try to meet CPU ID, no need to assign
-	   CPU ID on every new message. I do this to free
-	   my eyes from if's. */
-	mtk_w32(eth, idx, QDMA_CSR_RX_CPU_IDX);
-#ifdef RX_DEBUG
-	printk("rx0_done (2) CPU = %d, DMA = %d.",
-	       mtk_r32(eth, QDMA_CSR_RX_CPU_IDX),
-	       mtk_r32(eth, QDMA_CSR_RX_DMA_IDX));
-#endif
-}
 
-static void tx0_recycle_if_required(struct mtk_eth *eth)
-{
-	int val, idx, len, i;
-	
-	/* Irq queue keeps indexes of sent tx dscp's so we know
-	   which skb's and dscp's we can free. TX interrupt can 
-	   be configured to trigger once in N messages, 
-	   QDMA_CSR_TX_DELAY_INT_CFG. 
-	   See 7512_eth.c qdma_bm_transmit_done.
-	   
-	   I free skb's in xmit. It looks like irq queue is not necessary,
-	   but this simplified mode did not work. 
-	   
-	   TODO. */
+	qdma_tx_unmap_buf(ch->qdma->eth, buf);
 
-	/*  The IRQ_FULL interrupt will be triggered if len == QUEUE_DEPTH.
+	if (buf->type != MTK_TX_BUF_SKB) {
+		struct xdp_frame *xdpf = buf->xdpf;
 
-	    Clean the queue counter. 
+		buf->xdpf = NULL;
+		buf->type = MTK_TX_BUF_SKB;
+		if (done) {
+			done->xdp_pkts++;
+			done->xdp_bytes += xdpf->len;
+		}
+		/* Not from the RX NAPI, so no direct recycling */
+		xdp_return_frame(xdpf);
+		return;
+	}
 
-	    The counter will not be set 0 by writing to CLEAR_LEN reg, it 
-	    will continue until len == IRQ_DEPTH and then begin 
-	    from 0. */
-	
-	val = mtk_r32(eth, QDMA_CSR_IRQ_STATUS);
-	idx = val & IRQ_STATUS_HEAD_IDX_MASK;
-	len = (val & IRQ_STATUS_ENTRY_LEN_MASK) >> IRQ_STATUS_ENTRY_LEN_SHIFT;
-	/* printk("IRQ Q STATUS %x, %d, %d.", val, idx, len); */
+	skb = buf->skb;
+	buf->skb = NULL;
+	if (!skb)
+		return;
+	if (done) {
+		struct mtk_mac *mac = netdev_priv(skb->dev);
+		u16 q = skb_get_queue_mapping(skb);
 
-	for (i = 0; i < len; i++) {
-		irq_queue[i] = IRQ_DEF_VALUE;
+		mac->tx_inflight[q] -= skb_shinfo(skb)->nr_frags + 1;
+		done->pkts[q]++;
+		done->bytes[q] += skb->len;
 	}
-	mtk_w32(eth, len & 0x7F, QDMA_CSR_IRQ_CLEAR_LEN);
+	napi_consume_skb(skb, budget);
 }
 
-static irqreturn_t mtk_handle_irq(int irq, void *_eth)
+/* Free everything from the tail up to and including idx, called with
+ * tx_lock held.
+ */
+static void qdma_tx_complete(struct qdma_chain *ch, int idx, int budget,
+			     struct mtk_tx_done *done)
 {
-	struct mtk_eth *eth = _eth;
-	int status, mask;
+	struct qdma_ring *ring = &ch->tx_ring;
+	int n;
 
-	mask = mtk_r32(eth, MTK_QDMA_INT_MASK);
-	status = mtk_r32(eth, MTK_QDMA_INT_STATUS);
-	
-	pr_debug("mtk int mask=%x status=%x.", mask, status);
+	/* The hardware can't complete what it was never given, nor what it
+	 * has not written back. Which chain an entry names is a guess, a
+	 * wrong one must not free buffers which are still being sent.
+	 */
+	n = ((idx - ring->tail) & (ring->size - 1)) + 1;
+	if (n > qdma_ring_used(ring) ||
+	    !is_desc_done(qdma_ring_desc(ring, idx))) {
+		ch->qdma->tx_done_stray++;
+		return;
+	}
+	/* Nothing of the descriptors before the done bit */
+	dma_rmb();
 
-	if (status & INT_STATUS_RX0_DONE) {
-		rx0_done(eth);
-	} else if (status & INT_STATUS_TX0_DONE) {
-		tx0_recycle_if_required(eth);
+	while (n--) {
+		idx = qdma_ring_pop(ring);
+		/* TODO: If dropped, adjust drop counter. */
+		qdma_tx_free_buf(ch, idx, budget, done);
 	}
-	
-	mtk_w32(eth, status & mask, MTK_QDMA_INT_STATUS);
-	
-	return IRQ_HANDLED;
 }
 
-static void qdma_initialize_hw_fwd(struct mtk_eth *eth) {
-	dma_addr_t phys_addr;
-	int i, val, len;
+/* Walk the Done List, the hardware appends the index of each TX descriptor
+ * as it finishes with it. See 7512_eth.c qdma_bm_transmit_done. Everything
+ * from the stack goes out on QDMA_TX_CHAIN, QDMA_XSK_CHAIN only sends for
+ * AF_XDP and its TX ring is only touched from the TX NAPI.
+ *
+ * Returns: true if there are more entries than the budget allowed for.
+ */
+static bool qdma_tx_poll_done_list(struct qdma *qdma, int budget)
+{
+	struct qdma_chain *ch = &qdma->chains[QDMA_TX_CHAIN];
+	struct net_device *dev = qdma_netdev(qdma);
+	struct mtk_tx_done done = {};
+	u32 pkts, bytes;
+	int val, head, len, i, n, q;
+	u32 entry;
+
+	val = qdma_r32(qdma, irq_status);
+	head = (val & IRQ_STATUS_HEAD_IDX_MASK) % QDMA_IRQ_QUEUE_DEPTH;
+	len = (val & IRQ_STATUS_ENTRY_LEN_MASK) >> IRQ_STATUS_ENTRY_LEN_SHIFT;
 
-	// mtk/linux-2.6.36/*.i, qdma_bm_dscp_init().
-	// DSCP "done" marking will not begin if this is not set.
-	mtk_w32(eth, 0x14 << 16, QDMA_CSR_LMGR_INIT_CFG);
-	
-	// Alloc mem for HWFWD_DSCPs.
-	len = QDMA_HWFWD_DESC_SIZE * HWFWD_DSCP_NUM;
-	hw_fwd_ary = dma_alloc_coherent(eth->dev,
-					len, &phys_addr, GFP_ATOMIC);
-	memset(hw_fwd_ary, 0, len);
-	mtk_w32(eth, phys_addr, QDMA_CSR_HWFWD_DSCP_BASE);
+	spin_lock(&ch->tx_lock);
 
-	// Alloc HWFWD buf, depends on payload size.
-	hw_fwd_buff = dma_alloc_coherent(eth->dev, 2048, &phys_addr, GFP_ATOMIC);
-	memset(hw_fwd_buff, 0, 2048);
-	mtk_w32(eth, phys_addr, QDMA_CSR_HWFWD_BUFF_BASE);
+	for (i = 0; i < len && i < budget; i++) {
+		entry = READ_ONCE(qdma->irq_queue[head]);
+		if (entry == IRQ_DEF_VALUE)
+			break;
+		qdma->irq_queue[head] = IRQ_DEF_VALUE;
+		head = (head + 1) % QDMA_IRQ_QUEUE_DEPTH;
+
+		qdma_tx_complete(&qdma->chains[FIELD_GET(IRQ_ENTRY_CHAIN,
+							 entry)],
+				 FIELD_GET(IRQ_ENTRY_DESC_IDX_MASK, entry),
+				 budget, &done);
+	}
 
-	val = mtk_r32(eth, QDMA_CSR_LMGR_INIT_CFG);
-	mtk_w32(eth, val | HWFWD_DSCP_NUM, QDMA_CSR_LMGR_INIT_CFG);
-	// Payload.
-	mtk_w32(eth, 0 << 28, QDMA_CSR_HWFWD_DSCP_CFG);
-	// Set threshold.
-	mtk_w32(eth, 1, QDMA_CSR_HWFWD_DSCP_CFG);
+	if (qdma_ring_free(&ch->tx_ring) >= TX0_WAKE_THRESH)
+		mtk_tx_wake_queues(qdma);
 
-	// Bootloader register value.
-	// mtk_w32(eth, 0x1180004, QDMA_CSR_LMGR_INIT_CFG);
+	spin_unlock(&ch->tx_lock);
 
-	val = mtk_r32(eth, QDMA_CSR_LMGR_INIT_CFG);
-	mtk_w32(eth, val | QDMA_CSR_LMGR_START_BIT, QDMA_CSR_LMGR_INIT_CFG);	
-	// Wait for init.
-	for (i = 0; i < 100; i++) {
-		val = mtk_r32(eth, QDMA_CSR_LMGR_INIT_CFG);
-		if ((val & QDMA_CSR_LMGR_START_BIT) == 0)
-			break;
+	if (done.xsk_frames)
+		xsk_tx_completed(qdma->chains[QDMA_XSK_CHAIN].xsk_pool,
+				 done.xsk_frames);
+
+	pkts = done.xdp_pkts;
+	bytes = done.xdp_bytes;
+	for (q = 0; q < MTK_QDMA_TX_QUEUES; q++) {
+		if (!done.pkts[q])
+			continue;
+		pkts += done.pkts[q];
+		bytes += done.bytes[q];
+		netdev_tx_completed_queue(netdev_get_tx_queue(dev, q),
+					  done.pkts[q], done.bytes[q]);
 	}
-	// TODO: report init failure.
+	if (pkts) {
+		qdma->tx_packets += pkts;
+		qdma->tx_bytes += bytes;
+		mtk_stats_tx(netdev_priv(dev), pkts, bytes);
+	}
+
+	/* The entry slots must be reset before the hardware may reuse them */
+	wmb();
+	for (n = i; n > 0; n -= IRQ_CLEAR_LEN_MAX)
+		qdma_w32(qdma, min(n, IRQ_CLEAR_LEN_MAX), irq_clear_len);
+
+	return i < len;
 }
 
-static void qdma_initialize_irq_queue(struct mtk_eth *eth)
+static struct qdma_desc *qdma_tx_get_dscp(struct qdma_chain *ch, int idx)
 {
-	dma_addr_t phys;
-	int len;
+	return &ch->descs[idx];
+}
 
-	len = QDMA_IRQ_QUEUE_DEPTH * sizeof(u32);
-	
-	irq_queue = dma_alloc_coherent(eth->dev, len, &phys, GFP_ATOMIC);
-	memset(irq_queue, IRQ_DEF_VALUE, len);
-	mtk_w32(eth, phys, QDMA_CSR_IRQ_BASE);
-	mtk_w32(eth, QDMA_IRQ_QUEUE_DEPTH, QDMA_CSR_IRQ_CFG);	
+static struct qdma_desc *qdma_rx_get_dscp(struct qdma_chain *ch, int idx)
+{
+	return &ch->descs[qdma_tx_ring_size[ch->id] + idx];
 }
 
-static void qdma_initialize_tx_ring(void) {
-	int i;
-	for (i = 0; i < TX0_DSCP_NUM - 1; i++)
-		set_desc_next_idx(&dscp_ary[i], i + 1);
+/* Fill the next descriptor with one piece of a packet, every piece carries
+ * the same TX message.
+ */
+static void qdma_tx_fill_dscp(struct qdma_chain *ch, int idx, dma_addr_t phys,
+			      unsigned int len, bool more,
+			      const struct qdma_desc_etx *tx_msg)
+{
+	struct qdma_desc *dscp = qdma_tx_get_dscp(ch, idx);
+
+	dscp->pkt_addr = phys;
+	dscp->pkt_len = len;
+	dscp->t.etx = *tx_msg;
+
+	/* N marks that the packet continues in the next descriptor */
+	set_desc_nls(dscp, more);
+
+	/* QDMA_CSR_DMA_IDX will move to an element with
+	   done = 0. If element is not found, `done` marking will stop. */
+	set_desc_done(dscp, false);
 }
 
-static void qdma_initialize_rx_ring(struct mtk_eth *eth) {
-	struct qdma_desc *dscp;
-	int i;
-	
-	for (i = 0; i < RX0_DSCP_NUM; i++) {
-		dscp = rx0_get_dscp(i);
-		rx0_dscp_defaults(dscp);
-		rx0_new_skb(eth, i, dscp);
-	}	
+/* Returns: the L4 protocol of an IPv4 or IPv6 packet, 0 for anything else */
+static u8 mtk_tx_l4proto(struct sk_buff *skb)
+{
+	switch (vlan_get_protocol(skb)) {
+	case htons(ETH_P_IP):
+		return ip_hdr(skb)->protocol;
+	case htons(ETH_P_IPV6):
+		return ipv6_hdr(skb)->nexthdr;
+	default:
+		return 0;
+	}
 }
 
-static int qdma_config(struct mtk_eth *eth)
+/* The engine only knows plain TCP and UDP over IPv4 and IPv6, anything else
+ * which asks for a checksum gets it done in software here.
+ */
+static int mtk_tx_csum_prepare(struct sk_buff *skb)
 {
-	// int err, i, val;	
-	dma_addr_t phys_addr;
-	
-	// Disable TX/RX.
-	mtk_w32(eth, 0, QDMA_CSR_GLB_CFG);
-	
-	dscp_ary = dma_alloc_coherent(eth->dev,
-			      sizeof(struct qdma_desc) * DSCP_NUM,
-				      &phys_addr,
-				      GFP_ATOMIC);
-	memset(dscp_ary, 0, sizeof(struct qdma_desc) * DSCP_NUM);
+	u8 l4proto;
 
-	struct en75_debug_conf debug_conf = {0};
-	debug_conf.qdma[0].regs = eth->base + 0x4000;
-	// pr_info("REGS=%.8x\n", (u32) debug_conf.qdma[0].regs);
-	debug_conf.qdma[0].chains[0].rx_descs = (struct qdma_desc *) rx0_get_dscp(0);
-	debug_conf.qdma[0].chains[0].rx_count = RX0_DSCP_NUM;
-	debug_conf.qdma[0].chains[0].tx_descs = (struct qdma_desc *) tx0_get_dscp(0);
-	debug_conf.qdma[0].chains[0].tx_count = TX0_DSCP_NUM;
-	eth->debug = en75_debugfs_init(&debug_conf);
+	if (skb->ip_summed != CHECKSUM_PARTIAL)
+		return 0;
 
-	// Set TX and RX DSCP addresses.
-	mtk_w32(eth, phys_addr, QDMA_CSR_TX_DSCP_BASE);
-	mtk_w32(eth, phys_addr + sizeof(struct qdma_desc) * TX0_DSCP_NUM, QDMA_CSR_RX_DSCP_BASE);
-	
-	mtk_w32(eth, DSCP_NUM - TX0_DSCP_NUM, QDMA_CSR_RX_RING_CFG);
-	mtk_w32(eth, 0, QDMA_CSR_RX_RING_THR);
+	l4proto = mtk_tx_l4proto(skb);
+	if (skb->encapsulation ||
+	    (l4proto != IPPROTO_TCP && l4proto != IPPROTO_UDP))
+		return skb_checksum_help(skb);
 
-	qdma_initialize_irq_queue(eth);
-	qdma_initialize_hw_fwd(eth);
+	return 0;
+}
 
-	qdma_initialize_tx_ring();	
-	// Set TX circular buffer/ring pointers.
-	mtk_w32(eth, 0, QDMA_CSR_TX_CPU_IDX);
-	mtk_w32(eth, 0, QDMA_CSR_TX_DMA_IDX);
-
-	qdma_initialize_rx_ring(eth);       	
-	mtk_w32(eth, 0, QDMA_CSR_RX_CPU_IDX);
-	mtk_w32(eth, 0, QDMA_CSR_RX_DMA_IDX);
-	mtk_w32(eth, RX0_DSCP_NUM, QDMA_CSR_RX_CPU_IDX);
-	
-	// QDMA_CSR_TX_DELAY_INT_CFG 
-	mtk_w32(eth, 0, 0x4058);
-	// RX_DELAY_INT_CFG
-	mtk_w32(eth, 0, 0x405C);
-
-	mtk_w32(eth, (1 << 27) | (1 << 26) | (1 << 28) | (0x3 << 4)
-		| QCFG_TX_DMA_EN | QCFG_RX_DMA_EN |
-		(1 << 6) | (1 << 4) | (1 << 5)
-		/* GLB_CFG_RX_2B_OFFSET. 7512_eth.c  _receive_buffer. */
-		/* | (1 << 31) */
-		/* GLB_CFG_IRQ_EN */
-	        | (1 << 19),
-		QDMA_CSR_GLB_CFG);
+static void mtk_tx_csum(struct sk_buff *skb, struct qdma_desc_etx *tx_msg)
+{
+	u8 l4proto;
 
-	/* Select interrupts.
-	   If INT_STATUS_TX0_DONE is off but GLB_CFG_IRQ_EN is on, 
-	   TX0_DONE interrupt will be triggered. 
-	   If INT_STATUS_TX0_DONE and GLB_CFG_IRQ_EN both on, TX0_DONE
-	   will be triggered even if no message was received. */	
-	mtk_w32(eth, INT_STATUS_HWFWD_DSCP_LOW |
-		INT_STATUS_IRQ_FULL |
-		INT_STATUS_HWFWD_DSCP_EMPTY |
-		INT_STATUS_NO_RX0_CPU_DSCP |
-		INT_STATUS_NO_TX0_CPU_DSCP |
-		INT_STATUS_RX0_DONE /* | INT_STATUS_TX0_DONE */,
-		MTK_QDMA_INT_MASK);
-	
-	// GDMA1_FWD_CFG from bootloader mem.
-	mtk_w32(eth, 0xC0000000, 0x500);
+	if (skb->ip_summed != CHECKSUM_PARTIAL)
+		return;
 
-	// GSW_PMCR from bootloader reg.
-	mtk_w32(eth, 0x9E30B, 0x8000 + 0x3000 + 5 * 0x100);
-	mtk_w32(eth, 0x9E30B, 0x8000 + 0x3000 + 6 * 0x100);
-	
-	// GSW_MFC, matches bootloader reg value.
-	mtk_w32(eth, (0xff << 24) | (0xff << 16) | (0xff << 8) | (1 << 7) | (6 << 4), 0x8000 + 0x10);
-	
-	return 0;
+	l4proto = mtk_tx_l4proto(skb);
+	set_etx_ico(tx_msg, vlan_get_protocol(skb) == htons(ETH_P_IP));
+	set_etx_tco(tx_msg, l4proto == IPPROTO_TCP);
+	set_etx_uco(tx_msg, l4proto == IPPROTO_UDP);
 }
 
-static int mtk_open(struct net_device *dev)
+/* The mtk tagger put the special tag in the packet, move it into the
+ * descriptor so the engine inserts it on the way to the switch. A VLAN tag
+ * which followed the special tag gets its TPID back. Based on
+ * airoha_get_dsa_tag().
+ *
+ * Returns: the special tag, 0 if there is none
+ */
+static u16 mtk_tx_dsa_tag(struct sk_buff *skb, struct net_device *dev)
 {
-	struct mtk_mac *mac = netdev_priv(dev);
-	struct mtk_eth *eth = mac->hw;
-	// int err;
+#if IS_ENABLED(CONFIG_NET_DSA)
+	struct ethhdr *ehdr;
+	u8 xmit_tpid;
+	u16 tag;
 
-	// err = phylink_of_phy_connect(mac->phylink, mac->of_node, 0);
-	// if (err) {
-	// 	netdev_err(dev, "%s: could not attach PHY: %d\n", __func__,
-	// 		   err);
-	// 	return err;
-	// }
+	if (!netdev_uses_dsa(dev))
+		return 0;
 
-	/* we run 2 netdevs on the same dma ring so we only bring it up once */
-	if (!refcount_read(&eth->dma_refcnt)) {
-		int err = qdma_config(eth);
+	if (dev->dsa_ptr->tag_ops->proto != DSA_TAG_PROTO_MTK)
+		return 0;
 
-		if (err)
-			return err;
+	if (skb_cow_head(skb, 0))
+		return 0;
 
-		// mtk_gdm_config(eth, MTK_GDMA_TO_PDMA);
+	ehdr = (struct ethhdr *)skb->data;
+	tag = be16_to_cpu(ehdr->h_proto);
+	xmit_tpid = tag >> 8;
 
-		// mtk_tx_irq_enable(eth, MTK_TX_DONE_INT); -- this was not me
-		// mtk_rx_irq_enable(eth, MTK_RX_DONE_INT);
-		refcount_set(&eth->dma_refcnt, 1);
+	switch (xmit_tpid) {
+	case MTK_HDR_XMIT_TAGGED_TPID_8100:
+		ehdr->h_proto = cpu_to_be16(ETH_P_8021Q);
+		tag &= ~(MTK_HDR_XMIT_TAGGED_TPID_8100 << 8);
+		break;
+	case MTK_HDR_XMIT_TAGGED_TPID_88A8:
+		ehdr->h_proto = cpu_to_be16(ETH_P_8021AD);
+		tag &= ~(MTK_HDR_XMIT_TAGGED_TPID_88A8 << 8);
+		break;
+	default:
+		memmove(skb->data + MTK_HDR_LEN, skb->data, 2 * ETH_ALEN);
+		__skb_pull(skb, MTK_HDR_LEN);
+		break;
 	}
-	else
-		refcount_inc(&eth->dma_refcnt);
 
-	// phylink_start(mac->phylink);
-	netif_start_queue(dev);
+	return tag;
+#else
 	return 0;
+#endif
 }
 
-static void mtk_stop_dma(struct mtk_eth *eth, u32 glo_cfg)
+/* Let the engine insert the tag rather than pushing it into the header */
+static void mtk_tx_vlan(struct sk_buff *skb, struct qdma_desc_etx *tx_msg)
 {
-	u32 val;
-	int i;
-
-	/* stop the dma engine */
-	spin_lock_bh(&eth->page_lock);
-	val = mtk_r32(eth, glo_cfg);
-	mtk_w32(eth, val & ~(QCFG_TX_WB_DONE | QCFG_RX_DMA_EN | QCFG_TX_DMA_EN),
-		glo_cfg);
-	spin_unlock_bh(&eth->page_lock);
+	if (!skb_vlan_tag_present(skb))
+		return;
 
-	/* wait for dma stop */
-	for (i = 0; i < 10; i++) {
-		val = mtk_r32(eth, glo_cfg);
-		if (val & (QCFG_TX_DMA_BUSY | QCFG_RX_DMA_BUSY)) {
-			msleep(20);
-			continue;
-		}
-		break;
-	}
+	set_etx_vlan_en(tx_msg, true);
+	set_etx_vlan_type(tx_msg, skb->vlan_proto == htons(ETH_P_8021AD) ?
+			  ETX_VLAN_TYPE_88A8 : ETX_VLAN_TYPE_8100);
+	tx_msg->vlan_tag = skb_vlan_tag_get(skb);
 }
 
-static int mtk_stop(struct net_device *dev)
+/* Map the head and each fragment of the skb into consecutive descriptors.
+ * Called with tx_lock held and at least nr_frags + 1 free descriptors.
+ */
+static int mtk_tx_map(struct qdma_chain *ch, struct sk_buff *skb,
+		      struct net_device *dev, u16 sp_tag, u8 hw_queue)
 {
 	struct mtk_mac *mac = netdev_priv(dev);
 	struct mtk_eth *eth = mac->hw;
+	struct qdma_ring *ring = &ch->tx_ring;
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	int nr_frags = shinfo->nr_frags;
+	u16 head = ring->head;
+	struct qdma_desc_etx tx_msg = {};
+	struct mtk_tx_buf *buf;
+	unsigned int len;
+	dma_addr_t phys;
+	int i, idx;
 
-	en75_debugfs_exit(eth->debug);
-	eth->debug = NULL;
-
-	// phylink_stop(mac->phylink);
+#ifdef TX_DEBUG
+	printk("(1) CPU idx %d, DMA idx %d.",
+	       head, qchain_r32(ch, tx_hwi));
+#endif
 
-	netif_tx_disable(dev);
+	set_etx_fport(&tx_msg, mac->id ? ETX_FPORT_WAN : ETX_FPORT_LAN);
+	set_etx_sp_tag(&tx_msg, sp_tag);
+	set_etx_queue(&tx_msg, hw_queue);
+	mtk_tx_csum(skb, &tx_msg);
+	mtk_tx_vlan(skb, &tx_msg);
 
-	// phylink_disconnect_phy(mac->phylink);
+	len = skb_headlen(skb);
+	phys = dma_map_single(eth->dev, skb->data, len, DMA_TO_DEVICE);
+	if (dma_mapping_error(eth->dev, phys))
+		return -ENOMEM;
 
-	/* only shutdown DMA if this is the last user */
-	if (!refcount_dec_and_test(&eth->dma_refcnt))
-		return 0;
+	idx = qdma_ring_push(ring);
+	buf = &ch->tx_bufs[idx];
+	buf->dma = phys;
+	buf->len = len;
+	buf->is_frag = false;
+	qdma_tx_fill_dscp(ch, idx, phys, len, nr_frags > 0, &tx_msg);
+
+	for (i = 0; i < nr_frags; i++) {
+		skb_frag_t *frag = &shinfo->frags[i];
+
+		len = skb_frag_size(frag);
+		phys = skb_frag_dma_map(eth->dev, frag, 0, len, DMA_TO_DEVICE);
+		if (dma_mapping_error(eth->dev, phys))
+			goto err_unmap;
+
+		idx = qdma_ring_push(ring);
+		buf = &ch->tx_bufs[idx];
+		buf->dma = phys;
+		buf->len = len;
+		buf->is_frag = true;
+		qdma_tx_fill_dscp(ch, idx, phys, len, i + 1 < nr_frags,
+				  &tx_msg);
+	}
 
-	// mtk_gdm_config(eth, MTK_GDMA_DROP_ALL);
+	buf->skb = skb;
 
-	// mtk_tx_irq_disable(eth, MTK_TX_DONE_INT);
-	// mtk_rx_irq_disable(eth, MTK_RX_DONE_INT);
-	mtk_w32(eth, 0, MTK_QDMA_INT_MASK);
+	return 0;
 
-	mtk_stop_dma(eth, QDMA_CSR_GLB_CFG);
+err_unmap:
+	/* Nothing past head was given to the hardware yet, take it back */
+	for (idx = head; idx != ring->head; idx = qdma_ring_next(ring, idx))
+		qdma_tx_unmap_buf(eth, &ch->tx_bufs[idx]);
+	ring->head = head;
+	return -ENOMEM;
+}
 
-	mtk_dma_free(eth);
+/* Hand everything up to the software head to the hardware, called with
+ * tx_lock held.
+ */
+/* Nothing raises an interrupt when a packet was sent, the TX poll looks at
+ * the Done List some time after each doorbell instead.
+ */
+static enum hrtimer_restart mtk_tx_timer(struct hrtimer *timer)
+{
+	struct qdma *qdma = container_of(timer, struct qdma, tx_timer);
 
-	return 0;
+	napi_schedule(&qdma->tx_napi);
+	return HRTIMER_NORESTART;
 }
 
-static int mtk_hw_deinit(struct mtk_eth *eth)
+static void mtk_tx_timer_arm(struct qdma *qdma)
 {
-	if (!test_and_clear_bit(MTK_HW_INIT, &eth->state))
-		return 0;
+	u32 usecs = max_t(u32, READ_ONCE(qdma->tx_timer_usecs),
+			  MTK_TX_TIMER_MIN_USECS);
+
+	if (!hrtimer_active(&qdma->tx_timer))
+		hrtimer_start(&qdma->tx_timer, us_to_ktime(usecs),
+			      HRTIMER_MODE_REL);
+}
+
+static void mtk_tx_kick(struct qdma_chain *ch)
+{
+	/* The descriptors must be complete before the hardware sees them */
+	wmb();
+
+	qchain_w32(ch, ch->tx_ring.head, tx_cpui);
+	mtk_tx_timer_arm(ch->qdma);
+
+#ifdef TX_DEBUG
+	printk("(2) CPU idx %d, DMA idx %d.",
+	       qchain_r32(ch, tx_cpui), qchain_r32(ch, tx_hwi));
+#endif
+}
+
+/* Put one XDP frame on the TX chain, called with tx_lock held. XDP_TX
+ * frames still sit in their RX page_pool page which is already mapped,
+ * anything else is mapped here. The doorbell is left to the caller.
+ */
+static int qdma_xdp_xmit_frame(struct qdma *qdma, struct xdp_frame *xdpf,
+			       bool xdp_tx)
+{
+	struct mtk_mac *mac = netdev_priv(qdma_netdev(qdma));
+	struct qdma_chain *ch = &qdma->chains[QDMA_TX_CHAIN];
+	struct device *dev = qdma->eth->dev;
+	struct qdma_desc_etx tx_msg = {};
+	struct mtk_tx_buf *buf;
+	struct page *page;
+	dma_addr_t phys;
+	int idx;
+
+	if (unlikely(xdp_frame_has_frags(xdpf)))
+		return -EOPNOTSUPP;
+	if (unlikely(!qdma_ring_free(&ch->tx_ring)))
+		return -EBUSY;
+
+	if (xdp_tx) {
+		page = virt_to_head_page(xdpf->data);
+		phys = page_pool_get_dma_addr(page) +
+		       (xdpf->data - page_address(page));
+		dma_sync_single_for_device(dev, phys, xdpf->len,
+					   DMA_BIDIRECTIONAL);
+	} else {
+		phys = dma_map_single(dev, xdpf->data, xdpf->len,
+				      DMA_TO_DEVICE);
+		if (dma_mapping_error(dev, phys))
+			return -ENOMEM;
+	}
+
+	set_etx_fport(&tx_msg, mac->id ? ETX_FPORT_WAN : ETX_FPORT_LAN);
+
+	idx = qdma_ring_push(&ch->tx_ring);
+	buf = &ch->tx_bufs[idx];
+	buf->xdpf = xdpf;
+	buf->dma = phys;
+	buf->len = xdpf->len;
+	buf->is_frag = false;
+	buf->type = xdp_tx ? MTK_TX_BUF_XDP_TX : MTK_TX_BUF_XDP_NDO;
+	qdma_tx_fill_dscp(ch, idx, phys, xdpf->len, false, &tx_msg);
+
+	/* The stack would otherwise find the ring full while awake */
+	if (qdma_ring_free(&ch->tx_ring) < TX0_DESC_NEEDED)
+		mtk_tx_stop_queues(qdma);
+
+	return 0;
+}
+
+/* Move what userspace put on the AF_XDP TX ring onto the TX ring of the
+ * chain, called from the TX NAPI.
+ *
+ * Returns: true if the budget ran out before the AF_XDP ring did
+ */
+static bool qdma_xsk_xmit(struct qdma_chain *ch, int budget)
+{
+	struct mtk_mac *mac = netdev_priv(qdma_netdev(ch->qdma));
+	struct xsk_buff_pool *pool = ch->xsk_pool;
+	struct qdma_desc_etx tx_msg = {};
+	struct mtk_tx_buf *buf;
+	struct xdp_desc desc;
+	dma_addr_t phys;
+	int idx, sent = 0;
+
+	if (!pool)
+		return false;
+
+	/* Completions bring us back here, anything else needs a kick */
+	if (xsk_uses_need_wakeup(pool))
+		xsk_set_tx_need_wakeup(pool);
+
+	set_etx_fport(&tx_msg, mac->id ? ETX_FPORT_WAN : ETX_FPORT_LAN);
+
+	while (sent < budget && qdma_ring_free(&ch->tx_ring)) {
+		if (!xsk_tx_peek_desc(pool, &desc))
+			break;
+
+		phys = xsk_buff_raw_get_dma(pool, desc.addr);
+		xsk_buff_raw_dma_sync_for_device(pool, phys, desc.len);
+
+		idx = qdma_ring_push(&ch->tx_ring);
+		buf = &ch->tx_bufs[idx];
+		buf->dma = phys;
+		buf->len = desc.len;
+		buf->is_frag = false;
+		buf->type = MTK_TX_BUF_XSK;
+		qdma_tx_fill_dscp(ch, idx, phys, desc.len, false, &tx_msg);
+		sent++;
+	}
+
+	if (sent) {
+		xsk_tx_release(pool);
+		mtk_tx_kick(ch);
+	}
+
+	return sent == budget;
+}
+
+
+/* TX queue n goes to QDMA queue n, the engine serves higher numbered queues
+ * first. With mqprio each traffic class gets the one TX queue of the same
+ * number, see mtk_setup_tc_mqprio().
+ *
+ * Anything past the last queue, a classid from tc or net_prio or a large
+ * SO_PRIORITY, goes to the best effort queue so marked bulk traffic can't
+ * starve the high queues.
+ */
+static u16 mtk_select_queue(struct net_device *dev, struct sk_buff *skb,
+			    struct net_device *sb_dev)
+{
+	if (netdev_get_num_tc(dev))
+		return netdev_pick_tx(dev, skb, sb_dev);
+
+	if (skb->priority >= dev->real_num_tx_queues)
+		return 0;
+
+	return skb->priority;
+}
+
+static netdev_tx_t mtk_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+	struct qdma *qdma = mtk_mac_qdma(mac);
+	struct qdma_chain *ch = &qdma->chains[QDMA_TX_CHAIN];
+	u16 q = skb_get_queue_mapping(skb);
+	struct netdev_queue *txq = netdev_get_tx_queue(dev, q);
+	int ndesc;
+	u16 sp_tag;
+	bool stop;
+
+	/* The stack only serializes each TX queue, every queue of the MAC
+	 * lands in the one hardware ring.
+	 */
+	spin_lock(&ch->tx_lock);
+
+	if (unlikely(test_bit(MTK_RESETTING, &eth->state)))
+		goto drop;
+
+	/* The skb goes back to the stack untouched, so this comes before
+	 * anything below changes it. Only the lock holder takes descriptors,
+	 * there is at least as much room once it has been padded.
+	 */
+	if (unlikely(qdma_ring_free(&ch->tx_ring) <
+		     skb_shinfo(skb)->nr_frags + 1)) {
+		mtk_tx_stop_queues(qdma);
+		mtk_tx_kick(ch);
+		spin_unlock(&ch->tx_lock);
+		netif_err(eth, tx_queued, dev,
+			  "Tx Ring full when queue awake!\n");
+		return NETDEV_TX_BUSY;
+	}
+
+	/* Before padding, the packet gets shorter if the tag comes out */
+	sp_tag = mtk_tx_dsa_tag(skb, dev);
+
+	/* eth_skb_pad() frees the skb if it fails, it may also linearize it
+	 * so the fragments are counted after.
+	 */
+	if (eth_skb_pad(skb)) {
+		mtk_stats_tx_drop(mac);
+		goto dropped;
+	}
+
+	if (mtk_tx_csum_prepare(skb))
+		goto drop;
+
+	ndesc = skb_shinfo(skb)->nr_frags + 1;
+	if (mtk_tx_map(ch, skb, dev, sp_tag, q) < 0)
+		goto drop;
+
+	mac->tx_inflight[q] += ndesc;
+	stop = qdma_ring_free(&ch->tx_ring) < TX0_DESC_NEEDED;
+	if (stop) {
+		mtk_tx_stop_queues(qdma);
+	} else if (mac->tx_inflight[q] + TX0_DESC_NEEDED > TXQ_DESC_MAX) {
+		netif_tx_stop_queue(txq);
+		stop = true;
+	}
+
+	/* The stack will call again shortly if xmit_more is set, so the
+	 * doorbell is only rung once per burst. A queue stopped either here
+	 * or by BQL won't be called again so it has to ring now.
+	 */
+	if (__netdev_tx_sent_queue(txq, skb->len, netdev_xmit_more()) || stop)
+		mtk_tx_kick(ch);
+
+	spin_unlock(&ch->tx_lock);
+
+	return NETDEV_TX_OK;
+
+drop:
+	mtk_stats_tx_drop(mac);
+	dev_kfree_skb_any(skb);
+dropped:
+	/* Earlier packets of this burst may still be waiting for the doorbell */
+	if (!netdev_xmit_more())
+		mtk_tx_kick(ch);
+	spin_unlock(&ch->tx_lock);
+	return NETDEV_TX_OK;
+}
+
+static void mtk_tx_timeout(struct net_device *dev, unsigned int txqueue)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+	struct mtk_pcpu_stats *stats = this_cpu_ptr(mac->stats);
+
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_inc(&stats->tx_errors);
+	u64_stats_update_end(&stats->syncp);
+	netif_err(eth, tx_err, dev,
+		  "transmit timed out\n");
+	schedule_work(&eth->pending_work);
+}
+
+/* How much of an RX buffer the hardware may write, pkt_len is 16 bits */
+static u16 qdma_rx_pkt_len(struct qdma *qdma)
+{
+	return min_t(u32, SKB_WITH_OVERHEAD(qdma->rx_buf_size -
+					    qdma->rx_headroom), U16_MAX);
+}
+
+static bool qdma_rx_new_buf(struct qdma_chain *ch, int idx,
+			    struct qdma_desc *dscp)
+{
+	struct mtk_rx_buf *buf = &ch->rx_bufs[idx];
+	unsigned int offset;
+	struct page *page;
+
+	if (ch->xsk_pool) {
+		buf->xsk = xsk_buff_alloc(ch->xsk_pool);
+		if (!buf->xsk)
+			return false;
+		/* The frame keeps its data where the pool put it, the 2 bytes
+		 * come out of the XDP headroom in front of it.
+		 */
+		dscp->pkt_addr = xsk_buff_xdp_get_dma(buf->xsk) -
+				 MTK_RX_IP_ALIGN;
+		return true;
+	}
+
+	page = page_pool_dev_alloc_frag(ch->rx_page_pool, &offset,
+					ch->qdma->rx_buf_size);
+	if (!page)
+		return false;
+
+	/* Mapped once by the page_pool, not per packet */
+	buf->data = page_address(page) + offset;
+	buf->dma = page_pool_get_dma_addr(page) + offset;
+	dscp->pkt_addr = buf->dma + ch->qdma->rx_headroom - MTK_RX_IP_ALIGN;
+
+	return true;
+}
+
+static void qdma_rx_free_buf(struct qdma_chain *ch, int idx, bool allow_direct)
+{
+	struct mtk_rx_buf *buf = &ch->rx_bufs[idx];
+
+	if (buf->xsk) {
+		xsk_buff_free(buf->xsk);
+		buf->xsk = NULL;
+	}
+	if (!buf->data)
+		return;
+	page_pool_put_full_page(ch->rx_page_pool, virt_to_head_page(buf->data),
+				allow_direct);
+	buf->data = NULL;
+}
+
+/* Make what the hardware wrote visible to the CPU, a buffer which can't
+ * be used goes back to the page_pool.
+ *
+ * Returns: false if the buffer is gone
+ */
+static bool qdma_rx_sync(struct qdma_chain *ch, int idx, u32 len)
+{
+	struct mtk_rx_buf *buf = &ch->rx_bufs[idx];
+
+	if (unlikely(!buf->data))
+		return false;
+
+	if (unlikely(!len || len > qdma_rx_pkt_len(ch->qdma))) {
+		qdma_rx_free_buf(ch, idx, true);
+		return false;
+	}
+
+	/* Only what the hardware wrote needs to be invalidated */
+	dma_sync_single_for_cpu(ch->qdma->eth->dev,
+				buf->dma + ch->qdma->rx_headroom, len,
+				page_pool_get_dma_dir(ch->rx_page_pool));
+	return true;
+}
+
+/* Wrap the received buffer in an skb without copying it, on failure the
+ * buffer goes back to the page_pool. XDP may have moved the start of the
+ * packet so it is given as an offset into the buffer.
+ */
+static struct sk_buff *qdma_rx_build_skb(struct qdma_chain *ch, int idx,
+					 u32 offset, u32 len)
+{
+	struct mtk_rx_buf *buf = &ch->rx_bufs[idx];
+	struct sk_buff *skb;
+
+	skb = napi_build_skb(buf->data, ch->qdma->rx_buf_size);
+	if (unlikely(!skb)) {
+		qdma_rx_free_buf(ch, idx, true);
+		return NULL;
+	}
+
+	buf->data = NULL;
+	skb_mark_for_recycle(skb);
+	skb_reserve(skb, offset);
+	__skb_put(skb, len);
+
+	return skb;
+}
+
+/* Run the XDP program on a received buffer. Unless the verdict is
+ * XDP_PASS the buffer is used up, either sent, redirected or given back.
+ *
+ * Returns: the verdict, XDP_ABORTED for anything which failed
+ */
+static u32 qdma_rx_run_xdp(struct qdma_chain *ch, struct bpf_prog *prog,
+			   int idx, u32 *offset, u32 *len)
+{
+	struct qdma *qdma = ch->qdma;
+	struct net_device *dev = qdma_netdev(qdma);
+	struct qdma_chain *tx_ch = &qdma->chains[QDMA_TX_CHAIN];
+	struct mtk_rx_buf *buf = &ch->rx_bufs[idx];
+	struct xdp_frame *xdpf;
+	struct xdp_buff xdp;
+	u32 act;
+	int err;
+
+	xdp_init_buff(&xdp, qdma->rx_buf_size, &ch->xdp_rxq);
+	xdp_prepare_buff(&xdp, buf->data, *offset, *len, false);
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		*offset = xdp.data - xdp.data_hard_start;
+		*len = xdp.data_end - xdp.data;
+		return XDP_PASS;
+	case XDP_TX:
+		xdpf = xdp_convert_buff_to_frame(&xdp);
+		if (unlikely(!xdpf))
+			break;
+		spin_lock(&tx_ch->tx_lock);
+		err = qdma_xdp_xmit_frame(qdma, xdpf, true);
+		spin_unlock(&tx_ch->tx_lock);
+		if (err)
+			break;
+		buf->data = NULL;
+		return XDP_TX;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(dev, &xdp, prog))
+			break;
+		buf->data = NULL;
+		return XDP_REDIRECT;
+	default:
+		bpf_warn_invalid_xdp_action(dev, prog, act);
+		fallthrough;
+	case XDP_ABORTED:
+		break;
+	case XDP_DROP:
+		qdma_rx_free_buf(ch, idx, true);
+		return XDP_DROP;
+	}
+
+	trace_xdp_exception(dev, prog, act);
+	qdma_rx_free_buf(ch, idx, true);
+	return XDP_ABORTED;
+}
+
+/* qdma_rx_run_xdp() for a UMEM frame of an AF_XDP chain. Only a redirect
+ * to the socket keeps the frame, XDP_TX sends a copy from chain 0.
+ */
+static u32 qdma_rx_run_xdp_zc(struct qdma_chain *ch, struct bpf_prog *prog,
+			      struct xdp_buff *xdp)
+{
+	struct qdma *qdma = ch->qdma;
+	struct net_device *dev = qdma_netdev(qdma);
+	struct qdma_chain *tx_ch = &qdma->chains[QDMA_TX_CHAIN];
+	struct xdp_frame *xdpf;
+	u32 act;
+	int err;
+
+	act = bpf_prog_run_xdp(prog, xdp);
+	switch (act) {
+	case XDP_PASS:
+		return XDP_PASS;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(dev, xdp, prog))
+			break;
+		return XDP_REDIRECT;
+	case XDP_TX:
+		xdpf = xdp_convert_zc_to_xdp_frame(xdp);
+		if (unlikely(!xdpf))
+			break;
+		spin_lock(&tx_ch->tx_lock);
+		err = qdma_xdp_xmit_frame(qdma, xdpf, false);
+		spin_unlock(&tx_ch->tx_lock);
+		if (err) {
+			xdp_return_frame(xdpf);
+			break;
+		}
+		xsk_buff_free(xdp);
+		return XDP_TX;
+	default:
+		bpf_warn_invalid_xdp_action(dev, prog, act);
+		fallthrough;
+	case XDP_ABORTED:
+		break;
+	case XDP_DROP:
+		xsk_buff_free(xdp);
+		return XDP_DROP;
+	}
+
+	trace_xdp_exception(dev, prog, act);
+	xsk_buff_free(xdp);
+	return XDP_ABORTED;
+}
+
+/* Receive one page_pool buffer, see qdma_rx_xsk() for the contract */
+static u32 qdma_rx_page(struct qdma_chain *ch, struct bpf_prog *prog,
+			int idx, u32 *len, struct sk_buff **skb)
+{
+	u32 offset = ch->qdma->rx_headroom;
+	u32 act;
+
+	if (!qdma_rx_sync(ch, idx, *len))
+		return XDP_ABORTED;
+
+	if (prog) {
+		act = qdma_rx_run_xdp(ch, prog, idx, &offset, len);
+		if (act != XDP_PASS)
+			return act;
+	}
+
+	*skb = qdma_rx_build_skb(ch, idx, offset, *len);
+	return *skb ? XDP_PASS : XDP_ABORTED;
+}
+
+/* Receive one UMEM frame of an AF_XDP chain. Without a program, or when
+ * it passes, the stack gets a copy and the frame goes back to the pool.
+ *
+ * Returns: the XDP verdict with *skb set for XDP_PASS, XDP_ABORTED if the
+ *          frame was dropped
+ */
+static u32 qdma_rx_xsk(struct qdma_chain *ch, struct napi_struct *napi,
+		       struct bpf_prog *prog, int idx, u32 *len,
+		       struct sk_buff **skb)
+{
+	struct mtk_rx_buf *buf = &ch->rx_bufs[idx];
+	struct xdp_buff *xdp = buf->xsk;
+	u32 act;
+
+	if (unlikely(!xdp))
+		return XDP_ABORTED;
+	buf->xsk = NULL;
+
+	if (unlikely(!*len ||
+		     *len > xsk_pool_get_rx_frame_size(ch->xsk_pool))) {
+		xsk_buff_free(xdp);
+		return XDP_ABORTED;
+	}
+
+	xsk_buff_set_size(xdp, *len);
+	xsk_buff_dma_sync_for_cpu(xdp);
+
+	if (prog) {
+		act = qdma_rx_run_xdp_zc(ch, prog, xdp);
+		if (act != XDP_PASS)
+			return act;
+	}
+
+	*len = xdp->data_end - xdp->data;
+	*skb = napi_alloc_skb(napi, *len);
+	if (*skb)
+		skb_put_data(*skb, xdp->data, *len);
+	xsk_buff_free(xdp);
+	return *skb ? XDP_PASS : XDP_ABORTED;
+}
+
+/* The hardware flags L4 checksum failures but has nothing which says that
+ * a checksum was actually checked, so only TCP and UDP are trusted, other
+ * protocols like ICMP are left to the stack.
+ *
+ * On the DSA conduit eth_type_trans() gives ETH_P_XDSA, the special tag is
+ * in the descriptor rather than the packet so the Ethernet header still
+ * has the real type and the L3 header follows it.
+ */
+static void qdma_rx_csum(struct net_device *dev, struct sk_buff *skb,
+			 struct qdma_desc_erx *rx_msg)
+{
+	__be16 proto = eth_hdr(skb)->h_proto;
+	u8 l4proto;
+
+	if (!(dev->features & NETIF_F_RXCSUM))
+		return;
+
+	if (is_erx_l4f(rx_msg) || is_erx_ip4f(rx_msg))
+		return;
+
+	if (is_erx_ip4(rx_msg) && proto == htons(ETH_P_IP) &&
+	    pskb_may_pull(skb, sizeof(struct iphdr)))
+		l4proto = ((struct iphdr *)skb->data)->protocol;
+	else if (is_erx_ip6(rx_msg) && proto == htons(ETH_P_IPV6) &&
+		 pskb_may_pull(skb, sizeof(struct ipv6hdr)))
+		l4proto = ((struct ipv6hdr *)skb->data)->nexthdr;
+	else
+		return;
+
+	if (l4proto == IPPROTO_TCP || l4proto == IPPROTO_UDP)
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+}
+
+/* When the engine pops a tag it says so with untag and leaves the TCI in
+ * the descriptor. Nothing says whether it was an 802.1Q or an 802.1ad tag,
+ * the QinQ outer tag is assumed to stay in the packet.
+ */
+static void qdma_rx_vlan(struct sk_buff *skb, struct qdma_desc_erx *rx_msg)
+{
+	if (is_erx_untag(rx_msg))
+		__vlan_hwaccel_put_tag(skb, htons(ETH_P_8021Q), rx_msg->tci);
+}
+
+/* The PPE looks up every packet which goes through it by the hash of its
+ * tuple, so the entry index is the same for all packets of a flow and
+ * stands in for the software flow hash.
+ */
+static void qdma_rx_hash(struct net_device *dev, struct sk_buff *skb,
+			 struct qdma_desc_erx *rx_msg)
+{
+	u16 entry;
+
+	if (!(dev->features & NETIF_F_RXHASH))
+		return;
+
+	entry = get_erx_ppe_entry(rx_msg);
+	if (entry != ERX_PPE_ENTRY_NONE)
+		skb_set_hash(skb, jhash_1word(entry, 0), PKT_HASH_TYPE_L4);
+}
+
+/* Why the packet came to the CPU rather than being forwarded by the PPE */
+static void qdma_rx_crsn(struct qdma *qdma, struct qdma_desc_erx *rx_msg)
+{
+	u64_stats_update_begin(&qdma->rx_crsn_syncp);
+	u64_stats_inc(&qdma->rx_crsn[get_erx_crsn(rx_msg)]);
+	u64_stats_update_end(&qdma->rx_crsn_syncp);
+}
+
+/* The switch port is in the descriptor rather than in the packet, hand it
+ * to DSA as a metadata dst so no tagger has to parse anything.
+ */
+static void qdma_rx_dsa_port(struct mtk_eth *eth, struct sk_buff *skb,
+			     struct qdma_desc_erx *rx_msg)
+{
+	u16 port;
+
+	if (!netdev_uses_dsa(skb->dev))
+		return;
+
+	port = FIELD_GET(MTK_HDR_RECV_SOURCE_PORT_MASK, rx_msg->sp_tag);
+	if (eth->dsa_meta[port])
+		skb_dst_set_noref(skb, &eth->dsa_meta[port]->dst);
+}
+
+static void qdma_rx_dscp_defaults(struct qdma_chain *ch,
+				  struct qdma_desc *dscp)
+{
+	/* How much the hardware may write into the buffer */
+	if (ch->xsk_pool)
+		dscp->pkt_len = xsk_pool_get_rx_frame_size(ch->xsk_pool);
+	else
+		dscp->pkt_len = qdma_rx_pkt_len(ch->qdma);
+}
+
+/* Room for the headroom, the longest frame the MTU allows and the shared
+ * info. Jumbo frames get whole pages of a higher order.
+ */
+static u32 qdma_rx_buf_size(unsigned int mtu, u32 headroom)
+{
+	u32 size = SKB_DATA_ALIGN(headroom + mtu + MTK_RX_ETH_HLEN) +
+		   SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	if (size <= MTK_RX_BUF_SIZE_MIN)
+		return MTK_RX_BUF_SIZE_MIN;
+	return PAGE_SIZE << get_order(size);
+}
+
+static struct page_pool *qdma_rx_create_page_pool(struct qdma_chain *ch)
+{
+	unsigned int order = get_order(ch->qdma->rx_buf_size);
+	struct page_pool_params pp_params = {
+		.order = order,
+		.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV,
+		.pool_size = qdma_rx_ring_size[ch->id],
+		.nid = NUMA_NO_NODE,
+		.dev = ch->qdma->eth->dev,
+		/* XDP_TX sends straight out of the RX buffer */
+		.dma_dir = ch->qdma->xdp_prog ? DMA_BIDIRECTIONAL :
+						DMA_FROM_DEVICE,
+		.max_len = PAGE_SIZE << order,
+		.napi = &ch->qdma->rx_napi,
+	};
+
+	return page_pool_create(&pp_params);
+}
+
+/* Post fresh buffers into every slot which the hardware does not own,
+ * if an allocation fails we try again on the next poll.
+ */
+static void qdma_rx_refill(struct qdma_chain *ch)
+{
+	struct qdma_ring *ring = &ch->rx_ring;
+	struct qdma_desc *dscp;
+
+	while (qdma_ring_free(ring)) {
+		dscp = qdma_ring_desc(ring, ring->head);
+		qdma_rx_dscp_defaults(ch, dscp);
+		set_desc_done(dscp, false);
+		if (!qdma_rx_new_buf(ch, ring->head, dscp))
+			break;
+		qdma_ring_push(ring);
+	}
+}
+
+/* A zero limit means that condition is not used and the other one decides,
+ * bounded by the longest timer the hardware has.
+ */
+static u32 mtk_coal_val(u32 usecs, u32 frames)
+{
+	if (!usecs && !frames)
+		return 0;
+
+	usecs = usecs ? DIV_ROUND_UP(usecs, QDLY_PTIME_UNIT_US) :
+		FIELD_MAX(QDLY_MAX_PTIME_MASK);
+	frames = frames ?: FIELD_MAX(QDLY_MAX_PINT_MASK);
+
+	return QDLY_EN |
+		FIELD_PREP(QDLY_MAX_PTIME_MASK,
+			   min_t(u32, usecs, FIELD_MAX(QDLY_MAX_PTIME_MASK))) |
+		FIELD_PREP(QDLY_MAX_PINT_MASK,
+			   min_t(u32, frames, FIELD_MAX(QDLY_MAX_PINT_MASK)));
+}
+
+/* Program the fixed coalescing settings for whichever side is not adaptive,
+ * on every engine which is running.
+ */
+static void mtk_coal_apply(struct mtk_eth *eth)
+{
+	struct qdma *qdma;
+	int i;
+
+	for (i = 0; i < NUM_QDMA; i++) {
+		qdma = &eth->qdma[i];
+		if (!qdma->enabled)
+			continue;
+		if (!eth->rx_dim_enabled)
+			qdma_w32(qdma, mtk_coal_val(eth->rx_coal_usecs,
+						    eth->rx_coal_frames),
+				 rx_delay_int_cfg);
+		if (!eth->tx_dim_enabled) {
+			qdma_w32(qdma, mtk_coal_val(eth->tx_coal_usecs,
+						    eth->tx_coal_frames),
+				 tx_delay_int_cfg);
+			WRITE_ONCE(qdma->tx_timer_usecs, eth->tx_coal_usecs);
+		}
+	}
+}
+
+static void mtk_dim_rx(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct qdma *qdma = container_of(dim, struct qdma, rx_dim);
+	struct dim_cq_moder cur_profile;
+
+	cur_profile = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	qdma_w32(qdma, mtk_coal_val(cur_profile.usec, cur_profile.pkts),
+		 rx_delay_int_cfg);
+
+	dim->state = DIM_START_MEASURE;
+}
+
+static void mtk_dim_tx(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct qdma *qdma = container_of(dim, struct qdma, tx_dim);
+	struct dim_cq_moder cur_profile;
+
+	cur_profile = net_dim_get_tx_moderation(dim->mode, dim->profile_ix);
+	qdma_w32(qdma, mtk_coal_val(cur_profile.usec, cur_profile.pkts),
+		 tx_delay_int_cfg);
+	WRITE_ONCE(qdma->tx_timer_usecs, cur_profile.usec);
+
+	dim->state = DIM_START_MEASURE;
+}
+
+static void mtk_dim_update_rx(struct qdma *qdma)
+{
+	struct dim_sample dim_sample = {};
+
+	if (!qdma->eth->rx_dim_enabled)
+		return;
+	dim_update_sample(qdma->rx_events, qdma->rx_packets, qdma->rx_bytes,
+			  &dim_sample);
+	net_dim(&qdma->rx_dim, dim_sample);
+}
+
+static void mtk_dim_update_tx(struct qdma *qdma)
+{
+	struct dim_sample dim_sample = {};
+
+	if (!qdma->eth->tx_dim_enabled)
+		return;
+	dim_update_sample(qdma->tx_events, qdma->tx_packets, qdma->tx_bytes,
+			  &dim_sample);
+	net_dim(&qdma->tx_dim, dim_sample);
+}
+
+/* Receive up to budget packets from one chain and give its ring fresh
+ * buffers.
+ *
+ * Returns: the number of descriptors which were taken back
+ */
+static int qdma_rx_poll(struct qdma_chain *ch, struct napi_struct *napi,
+			int budget)
+{
+	struct qdma *qdma = ch->qdma;
+	struct net_device *dev = qdma_netdev(qdma);
+	struct qdma_ring *ring = &ch->rx_ring;
+	struct bpf_prog *prog = READ_ONCE(qdma->xdp_prog);
+	bool xdp_tx = false, xdp_redirect = false;
+	u32 pkts = 0, bytes = 0, drops = 0;
+	struct qdma_desc *dscp;
+	struct sk_buff *skb;
+	int idx, hw_idx, head, done = 0;
+	u32 len, act;
+
+	hw_idx = qchain_r32(ch, rx_hwi) % ring->size;
+#ifdef RX_DEBUG
+	printk("qdma_rx_poll (1) %d/%d CPU = %d, DMA = %d.",
+	       qdma->id, ch->id, ring->tail, hw_idx);
+#endif
+
+	while (done < budget && ring->tail != hw_idx &&
+	       qdma_ring_tail_done(ring)) {
+		/* Don't read pkt_len before we have seen the done bit */
+		dma_rmb();
+
+		idx = qdma_ring_pop(ring);
+		dscp = qdma_ring_desc(ring, idx);
+		len = dscp->pkt_len;
+		done++;
+		qdma_rx_crsn(qdma, &dscp->t.erx);
+
+		skb = NULL;
+		if (ch->xsk_pool)
+			act = qdma_rx_xsk(ch, napi, prog, idx, &len, &skb);
+		else
+			act = qdma_rx_page(ch, prog, idx, &len, &skb);
+		if (act == XDP_ABORTED) {
+			drops++;
+			continue;
+		}
+		xdp_tx |= act == XDP_TX;
+		xdp_redirect |= act == XDP_REDIRECT;
+		pkts++;
+		bytes += len;
+		if (!skb)
+			continue;
+
+		skb->protocol = eth_type_trans(skb, dev);
+		qdma_rx_csum(dev, skb, &dscp->t.erx);
+		qdma_rx_hash(dev, skb, &dscp->t.erx);
+		qdma_rx_vlan(skb, &dscp->t.erx);
+		qdma_rx_dsa_port(qdma->eth, skb, &dscp->t.erx);
+		napi_gro_receive(napi, skb);
+	}
+
+	if (xdp_redirect)
+		xdp_do_flush();
+	if (xdp_tx) {
+		struct qdma_chain *tx_ch = &qdma->chains[QDMA_TX_CHAIN];
+
+		spin_lock(&tx_ch->tx_lock);
+		mtk_tx_kick(tx_ch);
+		spin_unlock(&tx_ch->tx_lock);
+	}
+
+	if (done) {
+		qdma->rx_packets += pkts;
+		qdma->rx_bytes += bytes;
+		mtk_stats_rx(netdev_priv(dev), pkts, bytes, drops);
+	}
+
+	head = ring->head;
+	qdma_rx_refill(ch);
+	if (ring->head != head) {
+		/* Descriptors must be rewritten before the hardware sees
+		 * the new CPU index.
+		 */
+		wmb();
+		qchain_w32(ch, ring->head, rx_cpui);
+	}
+
+	/* An empty fill ring leaves slots unposted until userspace refills */
+	if (ch->xsk_pool && xsk_uses_need_wakeup(ch->xsk_pool)) {
+		if (qdma_ring_free(ring))
+			xsk_set_rx_need_wakeup(ch->xsk_pool);
+		else
+			xsk_clear_rx_need_wakeup(ch->xsk_pool);
+	}
+
+	return done;
+}
+
+static int mtk_poll_rx(struct napi_struct *napi, int budget)
+{
+	struct qdma *qdma = container_of(napi, struct qdma, rx_napi);
+	int i, done = 0;
+
+	qdma->rx_events++;
+
+	for (i = 0; i < NUM_QDMA_CHAINS && done < budget; i++)
+		done += qdma_rx_poll(&qdma->chains[i], napi, budget - done);
+
+	if (done < budget && napi_complete_done(napi, done)) {
+		mtk_dim_update_rx(qdma);
+		mtk_irq_enable(qdma, INT_STATUS_RX_NAPI);
+	}
+
+	return done;
+}
+
+static int mtk_poll_tx(struct napi_struct *napi, int budget)
+{
+	struct qdma *qdma = container_of(napi, struct qdma, tx_napi);
+	bool more;
+
+	qdma->tx_events++;
+
+	more = qdma_tx_poll_done_list(qdma, budget);
+	more |= qdma_xsk_xmit(&qdma->chains[QDMA_XSK_CHAIN], budget);
+	if (more)
+		return budget;
+
+	if (napi_complete(napi)) {
+		mtk_dim_update_tx(qdma);
+		mtk_irq_enable(qdma, INT_STATUS_TX_NAPI);
+		/* Come back for whatever is still being sent */
+		if (qdma_ring_used(&qdma->chains[QDMA_TX_CHAIN].tx_ring) ||
+		    qdma_ring_used(&qdma->chains[QDMA_XSK_CHAIN].tx_ring))
+			mtk_tx_timer_arm(qdma);
+	}
+
+	return 0;
+}
+
+/* Acknowledge the events of every engine which are in events and schedule
+ * the NAPI poll which handles them, the poll is masked until it is done.
+ */
+static void mtk_handle_events(struct mtk_eth *eth, u32 events, bool rx)
+{
+	struct qdma *qdma;
+	u32 status, mask, napi_mask;
+	int i;
+
+	napi_mask = rx ? INT_STATUS_RX_NAPI : INT_STATUS_TX_NAPI;
+
+	for (i = 0; i < NUM_QDMA; i++) {
+		qdma = &eth->qdma[i];
+		if (!qdma->enabled)
+			continue;
+
+		mask = qdma_r32(qdma, int_mask);
+		status = qdma_r32(qdma, int_status) & mask & events;
+		if (!status)
+			continue;
+
+		pr_debug("mtk int qdma%d mask=%x status=%x.", i, mask, status);
+
+		/* Write 1 to clear, the other handler's bits are left alone */
+		qdma_w32(qdma, status, int_status);
+
+		if (status & napi_mask) {
+			mtk_irq_disable(qdma, napi_mask);
+			napi_schedule(rx ? &qdma->rx_napi : &qdma->tx_napi);
+		}
+	}
+}
+
+static irqreturn_t mtk_handle_irq_rx(int irq, void *_eth)
+{
+	mtk_handle_events(_eth, ~INT_STATUS_TX_NAPI, true);
+
+	return IRQ_HANDLED;
+}
+
+static irqreturn_t mtk_handle_irq_tx(int irq, void *_eth)
+{
+	mtk_handle_events(_eth, INT_STATUS_TX_NAPI, false);
+
+	return IRQ_HANDLED;
+}
+
+/* Used when the DT only gives one interrupt line */
+static irqreturn_t mtk_handle_irq(int irq, void *_eth)
+{
+	mtk_handle_events(_eth, ~INT_STATUS_TX_NAPI, true);
+	mtk_handle_events(_eth, INT_STATUS_TX_NAPI, false);
+
+	return IRQ_HANDLED;
+}
+
+static u32 qdma_hwfwd_buff_size(struct qdma *qdma)
+{
+	return QDMA_HWFWD_BUFF_SIZE << qdma->hw_fwd_payload;
+}
+
+/* The smallest hardware forwarding payload which holds a whole frame */
+static u8 qdma_hwfwd_payload(unsigned int mtu)
+{
+	u8 n = 0;
+
+	while (n < HWFWD_PAYLOAD_SIZE_MAX &&
+	       (QDMA_HWFWD_BUFF_SIZE << n) < mtu + MTK_RX_ETH_HLEN)
+		n++;
+	return n;
+}
+
+static int qdma_initialize_hw_fwd(struct qdma *qdma)
+{
+	struct device *dev = qdma->eth->dev;
+	int i, val, len;
+
+	// mtk/linux-2.6.36/*.i, qdma_bm_dscp_init().
+	// DSCP "done" marking will not begin if this is not set.
+	qdma_w32(qdma, 0x14 << 16, lmgr_init_cfg);
+
+	// Alloc mem for HWFWD_DSCPs.
+	len = QDMA_HWFWD_DESC_SIZE * HWFWD_DSCP_NUM;
+	qdma->hw_fwd_ary = dma_alloc_coherent(dev, len, &qdma->hw_fwd_ary_phys,
+					      GFP_KERNEL);
+	if (!qdma->hw_fwd_ary)
+		return -ENOMEM;
+	qdma_w32(qdma, qdma->hw_fwd_ary_phys, hwfwd_dscp_base);
+
+	// Alloc HWFWD buf, depends on payload size.
+	qdma->hw_fwd_buff = dma_alloc_coherent(dev, qdma_hwfwd_buff_size(qdma),
+					       &qdma->hw_fwd_buff_phys,
+					       GFP_KERNEL);
+	if (!qdma->hw_fwd_buff)
+		return -ENOMEM;
+	qdma_w32(qdma, qdma->hw_fwd_buff_phys, hwfwd_buff_base);
+
+	val = qdma_r32(qdma, lmgr_init_cfg);
+	qdma_w32(qdma, val | HWFWD_DSCP_NUM, lmgr_init_cfg);
+	// Payload size and threshold share the register.
+	qdma_w32(qdma, qdma->hw_fwd_payload << HWFWD_PAYLOAD_SIZE_SHIFT | 1,
+		 hwfwd_dscp_cfg);
+
+	// Bootloader register value.
+	// qdma_w32(qdma, 0x1180004, lmgr_init_cfg);
+
+	val = qdma_r32(qdma, lmgr_init_cfg);
+	qdma_w32(qdma, val | QDMA_CSR_LMGR_START_BIT, lmgr_init_cfg);
+	// Wait for init.
+	for (i = 0; i < 100; i++) {
+		val = qdma_r32(qdma, lmgr_init_cfg);
+		if ((val & QDMA_CSR_LMGR_START_BIT) == 0)
+			break;
+	}
+	// TODO: report init failure.
+	return 0;
+}
+
+static int qdma_initialize_irq_queue(struct qdma *qdma)
+{
+	int len;
+
+	len = QDMA_IRQ_QUEUE_DEPTH * sizeof(u32);
+
+	qdma->irq_queue = dma_alloc_coherent(qdma->eth->dev, len,
+					     &qdma->irq_queue_phys, GFP_KERNEL);
+	if (!qdma->irq_queue)
+		return -ENOMEM;
+	memset(qdma->irq_queue, IRQ_DEF_VALUE, len);
+	qdma_w32(qdma, qdma->irq_queue_phys, irq_base);
+	qdma_w32(qdma, QDMA_IRQ_QUEUE_DEPTH, irq_cfg);
+	return 0;
+}
+
+/* Allocate both rings of a chain and hand the RX ring to the hardware */
+static int qdma_chain_config(struct qdma_chain *ch)
+{
+	struct device *dev = ch->qdma->eth->dev;
+	u16 tx_size = qdma_tx_ring_size[ch->id];
+	u16 rx_size = qdma_rx_ring_size[ch->id];
+	int err;
+
+	ch->descs = dma_alloc_coherent(dev, sizeof(struct qdma_desc) *
+				       (tx_size + rx_size),
+				       &ch->descs_phys, GFP_KERNEL);
+	if (!ch->descs)
+		return -ENOMEM;
+
+	ch->tx_bufs = kcalloc(tx_size, sizeof(*ch->tx_bufs), GFP_KERNEL);
+	ch->rx_bufs = kcalloc(rx_size, sizeof(*ch->rx_bufs), GFP_KERNEL);
+	if (!ch->tx_bufs || !ch->rx_bufs)
+		return -ENOMEM;
+
+	qdma_ring_init(&ch->tx_ring, qdma_tx_get_dscp(ch, 0), tx_size);
+	qdma_ring_init(&ch->rx_ring, qdma_rx_get_dscp(ch, 0), rx_size);
+
+	// Set TX and RX DSCP addresses.
+	qchain_w32(ch, ch->descs_phys, txbase);
+	qchain_w32(ch, ch->descs_phys + sizeof(struct qdma_desc) * tx_size,
+		   rxbase);
+
+	// Set TX circular buffer/ring pointers.
+	qchain_w32(ch, 0, tx_cpui);
+	qchain_w32(ch, 0, tx_hwi);
+
+	if (!ch->xsk_pool) {
+		ch->rx_page_pool = qdma_rx_create_page_pool(ch);
+		if (IS_ERR(ch->rx_page_pool)) {
+			err = PTR_ERR(ch->rx_page_pool);
+			ch->rx_page_pool = NULL;
+			return err;
+		}
+	}
+
+	/* Redirected frames find their way back to the page_pool from this */
+	err = xdp_rxq_info_reg(&ch->xdp_rxq, qdma_netdev(ch->qdma), ch->id,
+			       ch->qdma->rx_napi.napi_id);
+	if (err)
+		return err;
+	if (ch->xsk_pool) {
+		err = xdp_rxq_info_reg_mem_model(&ch->xdp_rxq,
+						 MEM_TYPE_XSK_BUFF_POOL, NULL);
+		xsk_pool_set_rxq_info(ch->xsk_pool, &ch->xdp_rxq);
+	} else {
+		err = xdp_rxq_info_reg_mem_model(&ch->xdp_rxq,
+						 MEM_TYPE_PAGE_POOL,
+						 ch->rx_page_pool);
+	}
+	if (err)
+		return err;
+
+	qdma_rx_refill(ch);
+	wmb();
+	qchain_w32(ch, 0, rx_cpui);
+	qchain_w32(ch, 0, rx_hwi);
+	qchain_w32(ch, ch->rx_ring.head, rx_cpui);
+
+	return 0;
+}
+
+static int qdma_config(struct qdma *qdma)
+{
+	unsigned int mtu = qdma_netdev(qdma)->mtu;
+	int err, i;
+
+	// Disable TX/RX.
+	qdma_w32(qdma, 0, cfg);
+
+	qdma->rx_headroom = qdma->xdp_prog ? MTK_RX_HEADROOM_XDP :
+					     MTK_RX_HEADROOM;
+	qdma->rx_buf_size = qdma_rx_buf_size(mtu, qdma->rx_headroom);
+	qdma->hw_fwd_payload = qdma_hwfwd_payload(mtu);
+
+	for (i = 0; i < NUM_QDMA_CHAINS; i++) {
+		err = qdma_chain_config(&qdma->chains[i]);
+		if (err)
+			return err;
+	}
+
+	qdma_w32(qdma, FIELD_PREP(QRXR_RING0_SIZE_MASK, RX0_DSCP_NUM) |
+		 FIELD_PREP(QRXR_RING1_SIZE_MASK, RX1_DSCP_NUM), rx_ring_cfg);
+	qdma_w32(qdma, 0, rx_ring_thr);
+
+	err = qdma_initialize_irq_queue(qdma);
+	if (err)
+		return err;
+	err = qdma_initialize_hw_fwd(qdma);
+	if (err)
+		return err;
+
+	mtk_coal_apply(qdma->eth);
+
+	qdma_w32(qdma, (1 << 27) | (1 << 26) | (1 << 28) | (0x3 << 4)
+		 | QCFG_TX_DMA_EN | QCFG_RX_DMA_EN |
+		 (1 << 6) | (1 << 4) | (1 << 5) |
+		 /* 7512_eth.c  _receive_buffer. */
+		 (MTK_RX_IP_ALIGN ? QCFG_RX_2B_OFFSET : 0)
+		 /* GLB_CFG_IRQ_EN */
+		 | (1 << 19),
+		 cfg);
+
+	/* Select interrupts.
+	   If INT_STATUS_TX0_DONE is off but GLB_CFG_IRQ_EN is on,
+	   TX0_DONE interrupt will be triggered.
+	   If INT_STATUS_TX0_DONE and GLB_CFG_IRQ_EN both on, TX0_DONE
+	   will be triggered even if no message was received.
+	   So TX0_DONE stays masked and the Done List is polled from
+	   mtk_tx_timer(), IRQ_FULL still gets it drained in time. */
+	qdma_w32(qdma, INT_STATUS_HWFWD_DSCP_LOW |
+		 INT_STATUS_HWFWD_DSCP_EMPTY |
+		 INT_STATUS_NO_RX0_CPU_DSCP |
+		 INT_STATUS_NO_RX1_CPU_DSCP |
+		 INT_STATUS_NO_TX0_CPU_DSCP |
+		 INT_STATUS_RX_NAPI |
+		 INT_STATUS_TX_NAPI,
+		 int_mask);
+
+	return 0;
+}
+
+/* Let frames of up to the MTU through the GDM and, unless DSA owns it,
+ * the switch.
+ */
+static void mtk_set_max_len(struct mtk_mac *mac)
+{
+	struct mtk_eth *eth = mac->hw;
+	struct net_device *dev = eth->netdev[mac->id];
+	u32 len = dev->mtu + MTK_RX_ETH_HLEN;
+	u32 val;
+
+	/* The length register of the second GDM is unknown, its max_mtu
+	 * keeps it within the default.
+	 */
+	if (mac->id)
+		return;
+
+	val = mtk_r32(eth, GDMA1_LEN_CFG);
+	val = u32_replace_bits(val, len, GDMA_LONG_LEN_MASK);
+	mtk_w32(eth, val, GDMA1_LEN_CFG);
+
+	/* The MT7530 driver programs the switch from port_change_mtu */
+	if (netdev_uses_dsa(dev))
+		return;
+
+	val = mtk_r32(eth, GSW_GMACCR);
+	val &= ~(GSW_MAX_RX_JUMBO_MASK | GSW_MAX_RX_PKT_LEN_MASK);
+	if (len <= 1522) {
+		val |= GSW_MAX_RX_PKT_LEN_1522;
+	} else if (len <= 1536) {
+		val |= GSW_MAX_RX_PKT_LEN_1536;
+	} else if (len <= 1552) {
+		val |= GSW_MAX_RX_PKT_LEN_1552;
+	} else {
+		val |= GSW_MAX_RX_PKT_LEN_JUMBO;
+		val |= FIELD_PREP(GSW_MAX_RX_JUMBO_MASK,
+				  DIV_ROUND_UP(len, 1024));
+	}
+	mtk_w32(eth, val, GSW_GMACCR);
+}
+
+/* Frame engine forwarding and the built in switch. Only GDM1 is set up,
+ * the forwarding register of GDM2 is unknown which is why mtk_add_mac()
+ * leaves MAC 1 out.
+ */
+static void mtk_gdm_config(struct mtk_eth *eth)
+{
+	u32 fwd = eth->ppe ? GDMA1_FWD_TO_PPE : 0;
+	int i;
+
+	for (i = 0; i < MTK_MAC_COUNT; i++)
+		if (eth->mac[i])
+			mtk_set_max_len(eth->mac[i]);
+
+	if (eth->netdev[0] && netdev_uses_dsa(eth->netdev[0])) {
+		// GDMA1_FWD_CFG from bootloader mem, plus the special tag.
+		mtk_w32(eth, 0xC0000000 | GDMA1_FWD_SPECIAL_TAG | fwd,
+			GDMA1_FWD_CFG);
+
+		// The DSA switch driver owns the switch ports.
+		return;
+	}
+
+	// GDMA1_FWD_CFG from bootloader mem.
+	mtk_w32(eth, 0xC0000000 | fwd, GDMA1_FWD_CFG);
+
+	// GSW_PMCR from bootloader reg.
+	mtk_w32(eth, 0x9E30B, 0x8000 + 0x3000 + 5 * 0x100);
+	mtk_w32(eth, 0x9E30B, 0x8000 + 0x3000 + 6 * 0x100);
+
+	// GSW_MFC, matches bootloader reg value.
+	mtk_w32(eth, (0xff << 24) | (0xff << 16) | (0xff << 8) | (1 << 7) | (6 << 4), 0x8000 + 0x10);
+}
+
+static void mtk_debugfs_init(struct mtk_eth *eth)
+{
+	struct en75_debug_conf debug_conf = {0};
+	struct qdma_chain *ch;
+	int i, j;
+
+	for (i = 0; i < NUM_QDMA; i++) {
+		if (!eth->qdma[i].enabled)
+			continue;
+		debug_conf.qdma[i].regs = eth->qdma[i].regs;
+		for (j = 0; j < NUM_QDMA_CHAINS; j++) {
+			ch = &eth->qdma[i].chains[j];
+			debug_conf.qdma[i].chains[j].rx_descs = ch->rx_ring.descs;
+			debug_conf.qdma[i].chains[j].rx_count = ch->rx_ring.size;
+			debug_conf.qdma[i].chains[j].tx_descs = ch->tx_ring.descs;
+			debug_conf.qdma[i].chains[j].tx_count = ch->tx_ring.size;
+		}
+	}
+	eth->debug = en75_debugfs_init(&debug_conf);
+}
+
+static void qdma_chain_free(struct qdma_chain *ch)
+{
+	struct device *dev = ch->qdma->eth->dev;
+	u16 tx_size = qdma_tx_ring_size[ch->id];
+	u16 rx_size = qdma_rx_ring_size[ch->id];
+	unsigned int xsk_frames = 0;
+	int i;
+
+	if (ch->tx_bufs) {
+		for (i = 0; i < tx_size; i++) {
+			/* AF_XDP gets back what was never sent as well */
+			if (ch->tx_bufs[i].type == MTK_TX_BUF_XSK)
+				xsk_frames++;
+			qdma_tx_free_buf(ch, i, 0, NULL);
+		}
+		if (xsk_frames)
+			xsk_tx_completed(ch->xsk_pool, xsk_frames);
+		kfree(ch->tx_bufs);
+		ch->tx_bufs = NULL;
+	}
+
+	if (ch->rx_bufs) {
+		for (i = 0; i < rx_size; i++)
+			qdma_rx_free_buf(ch, i, false);
+		kfree(ch->rx_bufs);
+		ch->rx_bufs = NULL;
+	}
+
+	if (ch->descs) {
+		dma_free_coherent(dev, sizeof(struct qdma_desc) *
+				  (tx_size + rx_size),
+				  ch->descs, ch->descs_phys);
+		ch->descs = NULL;
+	}
+
+	if (xdp_rxq_info_is_reg(&ch->xdp_rxq))
+		xdp_rxq_info_unreg(&ch->xdp_rxq);
+
+	if (ch->rx_page_pool) {
+		page_pool_destroy(ch->rx_page_pool);
+		ch->rx_page_pool = NULL;
+	}
+}
+
+/* Give back everything qdma_config() took, the DMA must be stopped */
+static void qdma_dma_free(struct qdma *qdma)
+{
+	struct device *dev = qdma->eth->dev;
+	struct net_device *netdev = qdma_netdev(qdma);
+	struct mtk_mac *mac = netdev_priv(netdev);
+	int i;
+
+	for (i = 0; i < netdev->num_tx_queues; i++)
+		netdev_tx_reset_queue(netdev_get_tx_queue(netdev, i));
+	memset(mac->tx_inflight, 0, sizeof(mac->tx_inflight));
+
+	for (i = 0; i < NUM_QDMA_CHAINS; i++)
+		qdma_chain_free(&qdma->chains[i]);
+
+	if (qdma->irq_queue) {
+		dma_free_coherent(dev, QDMA_IRQ_QUEUE_DEPTH * sizeof(u32),
+				  qdma->irq_queue, qdma->irq_queue_phys);
+		qdma->irq_queue = NULL;
+	}
+
+	if (qdma->hw_fwd_ary) {
+		dma_free_coherent(dev, QDMA_HWFWD_DESC_SIZE * HWFWD_DSCP_NUM,
+				  qdma->hw_fwd_ary, qdma->hw_fwd_ary_phys);
+		qdma->hw_fwd_ary = NULL;
+	}
+
+	if (qdma->hw_fwd_buff) {
+		dma_free_coherent(dev, qdma_hwfwd_buff_size(qdma),
+				  qdma->hw_fwd_buff, qdma->hw_fwd_buff_phys);
+		qdma->hw_fwd_buff = NULL;
+	}
+}
+
+static void mtk_stop_dma(struct qdma *qdma)
+{
+	struct mtk_eth *eth = qdma->eth;
+	u32 val;
+	int i;
+
+	/* stop the dma engine */
+	spin_lock_bh(&eth->page_lock);
+	val = qdma_r32(qdma, cfg);
+	qdma_w32(qdma, val & ~(QCFG_TX_WB_DONE | QCFG_RX_DMA_EN | QCFG_TX_DMA_EN),
+		 cfg);
+	spin_unlock_bh(&eth->page_lock);
+
+	/* wait for dma stop */
+	for (i = 0; i < 10; i++) {
+		val = qdma_r32(qdma, cfg);
+		if (val & (QCFG_TX_DMA_BUSY | QCFG_RX_DMA_BUSY)) {
+			msleep(20);
+			continue;
+		}
+		break;
+	}
+}
+
+static void mtk_qdma_stop(struct qdma *qdma)
+{
+	/* Other devices redirect to us from their NAPI, let that finish */
+	WRITE_ONCE(qdma->xdp_xmit, false);
+	synchronize_net();
+
+	qdma_w32(qdma, 0, int_mask);
+	napi_disable(&qdma->rx_napi);
+	napi_disable(&qdma->tx_napi);
+	hrtimer_cancel(&qdma->tx_timer);
+	cancel_work_sync(&qdma->rx_dim.work);
+	cancel_work_sync(&qdma->tx_dim.work);
+
+	mtk_stop_dma(qdma);
+	qdma_dma_free(qdma);
+	qdma->enabled = false;
+}
+
+/* On failure the engine is left stopped */
+static int mtk_qdma_start(struct qdma *qdma)
+{
+	int err;
+
+	qdma->enabled = true;
+	napi_enable(&qdma->rx_napi);
+	napi_enable(&qdma->tx_napi);
+
+	err = qdma_config(qdma);
+	if (err) {
+		mtk_qdma_stop(qdma);
+		return err;
+	}
+
+	WRITE_ONCE(qdma->xdp_xmit, true);
+	return 0;
+}
+
+/* Stop every engine which mtk_open() started and free its memory */
+static void mtk_dma_stop_all(struct mtk_eth *eth)
+{
+	int i;
+
+	for (i = 0; i < NUM_QDMA; i++)
+		if (eth->qdma[i].enabled)
+			mtk_qdma_stop(&eth->qdma[i]);
+}
+
+static int mtk_open(struct net_device *dev)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+	// int err;
+
+	// err = phylink_of_phy_connect(mac->phylink, mac->of_node, 0);
+	// if (err) {
+	// 	netdev_err(dev, "%s: could not attach PHY: %d\n", __func__,
+	// 		   err);
+	// 	return err;
+	// }
+
+	/* Both engines are brought up by whichever netdev opens first, they
+	 * share the interrupt and the frame engine.
+	 */
+	if (!refcount_read(&eth->dma_refcnt)) {
+		int err, i;
+
+		for (i = 0; i < NUM_QDMA; i++) {
+			if (!eth->netdev[i])
+				continue;
+
+			err = mtk_qdma_start(&eth->qdma[i]);
+			if (err) {
+				mtk_dma_stop_all(eth);
+				return err;
+			}
+		}
+
+		if (eth->ppe)
+			en75_ppe_start(eth->ppe);
+		mtk_gdm_config(eth);
+		mtk_debugfs_init(eth);
+
+		refcount_set(&eth->dma_refcnt, 1);
+	}
+	else
+		refcount_inc(&eth->dma_refcnt);
+
+	// phylink_start(mac->phylink);
+	netif_tx_start_all_queues(dev);
+	return 0;
+}
+
+static int mtk_stop(struct net_device *dev)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+
+	// phylink_stop(mac->phylink);
+
+	netif_tx_disable(dev);
+
+	// phylink_disconnect_phy(mac->phylink);
+
+	/* only shutdown DMA if this is the last user */
+	if (!refcount_dec_and_test(&eth->dma_refcnt))
+		return 0;
+
+	en75_debugfs_exit(eth->debug);
+	eth->debug = NULL;
+
+	// mtk_gdm_config(eth, MTK_GDMA_DROP_ALL);
+
+	if (eth->ppe && en75_ppe_stop(eth->ppe))
+		netdev_warn(dev, "PPE did not go idle\n");
+
+	mtk_dma_stop_all(eth);
+
+	return 0;
+}
+
+static void mtk_get_stats64(struct net_device *dev,
+			    struct rtnl_link_stats64 *s)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	u64 rx_packets, rx_bytes, rx_dropped;
+	u64 tx_packets, tx_bytes, tx_dropped, tx_errors;
+	unsigned int start;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct mtk_pcpu_stats *stats;
+
+		stats = per_cpu_ptr(mac->stats, cpu);
+		do {
+			start = u64_stats_fetch_begin(&stats->syncp);
+			rx_packets = u64_stats_read(&stats->rx_packets);
+			rx_bytes = u64_stats_read(&stats->rx_bytes);
+			rx_dropped = u64_stats_read(&stats->rx_dropped);
+			tx_packets = u64_stats_read(&stats->tx_packets);
+			tx_bytes = u64_stats_read(&stats->tx_bytes);
+			tx_dropped = u64_stats_read(&stats->tx_dropped);
+			tx_errors = u64_stats_read(&stats->tx_errors);
+		} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+		s->rx_packets += rx_packets;
+		s->rx_bytes += rx_bytes;
+		s->rx_dropped += rx_dropped;
+		s->tx_packets += tx_packets;
+		s->tx_bytes += tx_bytes;
+		s->tx_dropped += tx_dropped;
+		s->tx_errors += tx_errors;
+	}
+}
+
+/* Stop a running engine so its RX buffers can be set up differently,
+ * whatever it had in flight is dropped.
+ *
+ * Returns: true if mtk_qdma_resume() has to start it again
+ */
+static bool mtk_qdma_pause(struct mtk_mac *mac)
+{
+	struct qdma *qdma = mtk_mac_qdma(mac);
+	struct mtk_eth *eth = mac->hw;
+
+	if (!qdma->enabled)
+		return false;
+
+	netif_tx_disable(eth->netdev[mac->id]);
+	/* debugfs points at the descriptors which are about to go */
+	en75_debugfs_exit(eth->debug);
+	eth->debug = NULL;
+	mtk_qdma_stop(qdma);
+	return true;
+}
+
+static int mtk_qdma_resume(struct mtk_mac *mac)
+{
+	struct net_device *dev = mac->hw->netdev[mac->id];
+	int err;
+
+	err = mtk_qdma_start(mtk_mac_qdma(mac));
+	mtk_debugfs_init(mac->hw);
+	if (err) {
+		netdev_err(dev, "failed to restart DMA: %d\n", err);
+		return err;
+	}
+
+	if (netif_running(dev))
+		netif_tx_start_all_queues(dev);
+	return 0;
+}
+
+/* XDP wants the whole frame in one buffer and a buffer of one page */
+static bool mtk_xdp_mtu_ok(unsigned int mtu)
+{
+	return qdma_rx_buf_size(mtu, MTK_RX_HEADROOM_XDP) <= PAGE_SIZE;
+}
+
+/* Same for AF_XDP, a frame of the UMEM has to hold a whole packet */
+static bool mtk_xsk_mtu_ok(struct xsk_buff_pool *pool, unsigned int mtu)
+{
+	return xsk_pool_get_rx_frame_size(pool) >= mtu + MTK_RX_ETH_HLEN;
+}
+
+/* The RX buffers are sized for the MTU so a running engine is restarted */
+static int mtk_change_mtu(struct net_device *dev, int new_mtu)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct xsk_buff_pool *xsk;
+	bool restart;
+
+	xsk = mtk_mac_qdma(mac)->chains[QDMA_XSK_CHAIN].xsk_pool;
+
+	if (mtk_mac_qdma(mac)->xdp_prog && !mtk_xdp_mtu_ok(new_mtu)) {
+		netdev_err(dev, "MTU %d is too large for XDP\n", new_mtu);
+		return -EINVAL;
+	}
+	if (xsk && !mtk_xsk_mtu_ok(xsk, new_mtu)) {
+		netdev_err(dev, "MTU %d is too large for AF_XDP\n", new_mtu);
+		return -EINVAL;
+	}
+
+	restart = mtk_qdma_pause(mac);
+
+	WRITE_ONCE(dev->mtu, new_mtu);
+	mtk_set_max_len(mac);
+
+	if (!restart)
+		return 0;
+	return mtk_qdma_resume(mac);
+}
+
+/* Attaching or removing a program changes the RX headroom and how the
+ * page_pool maps its pages, so a running engine is restarted.
+ */
+static int mtk_xdp_setup(struct net_device *dev, struct bpf_prog *prog,
+			 struct netlink_ext_ack *extack)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct qdma *qdma = mtk_mac_qdma(mac);
+	struct bpf_prog *old_prog;
+	bool restart = false;
+	int err = 0;
+
+	if (prog && !mtk_xdp_mtu_ok(dev->mtu)) {
+		NL_SET_ERR_MSG_MOD(extack, "MTU too large for XDP");
+		return -EOPNOTSUPP;
+	}
+
+	/* Swapping one program for another needs no new buffers */
+	if (!!qdma->xdp_prog != !!prog)
+		restart = mtk_qdma_pause(mac);
+
+	old_prog = xchg(&qdma->xdp_prog, prog);
+
+	if (restart)
+		err = mtk_qdma_resume(mac);
+	if (err) {
+		/* Back to the old program, the core drops the reference it
+		 * gave us to the new one when this fails.
+		 */
+		xchg(&qdma->xdp_prog, old_prog);
+		mtk_qdma_resume(mac);
+		return err;
+	}
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+	return 0;
+}
+
+/* AF_XDP takes over QDMA_XSK_CHAIN, its RX ring is filled from the UMEM
+ * and its TX ring is fed from the socket. Chain 0 stays with the stack.
+ */
+static int mtk_xsk_setup(struct net_device *dev, struct xsk_buff_pool *pool,
+			 u16 qid)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct qdma_chain *ch = &mtk_mac_qdma(mac)->chains[QDMA_XSK_CHAIN];
+	struct xsk_buff_pool *old_pool = ch->xsk_pool;
+	bool restart;
+	int err;
+
+	if (qid != QDMA_XSK_CHAIN)
+		return -EINVAL;
+
+	if (pool) {
+		if (old_pool)
+			return -EBUSY;
+		if (!mtk_xsk_mtu_ok(pool, dev->mtu)) {
+			netdev_err(dev, "AF_XDP frames too small for the MTU\n");
+			return -EINVAL;
+		}
+		err = xsk_pool_dma_map(pool, mac->hw->dev, 0);
+		if (err)
+			return err;
+	} else if (!old_pool) {
+		return 0;
+	}
+
+	restart = mtk_qdma_pause(mac);
+	ch->xsk_pool = pool;
+	if (old_pool)
+		xsk_pool_dma_unmap(old_pool, 0);
+
+	if (!restart)
+		return 0;
+	err = mtk_qdma_resume(mac);
+	if (err && pool) {
+		/* The socket won't use the pool, the chain goes back to the
+		 * stack. A pool being removed is gone either way.
+		 */
+		ch->xsk_pool = NULL;
+		xsk_pool_dma_unmap(pool, 0);
+		mtk_qdma_resume(mac);
+	}
+	return err;
+}
+
+static int mtk_xsk_wakeup(struct net_device *dev, u32 qid, u32 flags)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct qdma *qdma = mtk_mac_qdma(mac);
+
+	if (unlikely(!READ_ONCE(qdma->xdp_xmit) || !netif_running(dev)))
+		return -ENETDOWN;
+	if (qid != QDMA_XSK_CHAIN || !qdma->chains[qid].xsk_pool)
+		return -EINVAL;
+
+	if ((flags & XDP_WAKEUP_RX) &&
+	    !napi_if_scheduled_mark_missed(&qdma->rx_napi))
+		napi_schedule(&qdma->rx_napi);
+	if ((flags & XDP_WAKEUP_TX) &&
+	    !napi_if_scheduled_mark_missed(&qdma->tx_napi))
+		napi_schedule(&qdma->tx_napi);
+
+	return 0;
+}
+
+static int mtk_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return mtk_xdp_setup(dev, xdp->prog, xdp->extack);
+	case XDP_SETUP_XSK_POOL:
+		return mtk_xsk_setup(dev, xdp->xsk.pool, xdp->xsk.queue_id);
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Frames redirected to this device by XDP, they carry no DSA tag so with
+ * a DSA switch they leave through the CPU port's default forwarding.
+ */
+static int mtk_xdp_xmit(struct net_device *dev, int n,
+			struct xdp_frame **frames, u32 flags)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct qdma *qdma = mtk_mac_qdma(mac);
+	struct qdma_chain *ch = &qdma->chains[QDMA_TX_CHAIN];
+	int i, sent = 0;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+	if (unlikely(!READ_ONCE(qdma->xdp_xmit) || !netif_running(dev)))
+		return -ENETDOWN;
+
+	spin_lock(&ch->tx_lock);
+	for (i = 0; i < n; i++) {
+		if (qdma_xdp_xmit_frame(qdma, frames[i], false))
+			break;
+		sent++;
+	}
+	if (flags & XDP_XMIT_FLUSH)
+		mtk_tx_kick(ch);
+	spin_unlock(&ch->tx_lock);
+
+	/* The caller frees what was not sent */
+	for (i = sent; i < n; i++)
+		mtk_stats_tx_drop(mac);
+	return sent;
+}
+
+static int mtk_hw_deinit(struct mtk_eth *eth)
+{
+	if (!test_and_clear_bit(MTK_HW_INIT, &eth->state))
+		return 0;
 
 	pm_runtime_put_sync(eth->dev);
 	pm_runtime_disable(eth->dev);
@@ -864,7 +2644,27 @@ static void mtk_uninit(struct net_device *dev)
 	// phylink_disconnect_phy(mac->phylink);
 	// mtk_tx_irq_disable(eth, ~0);
 	// mtk_rx_irq_disable(eth, ~0);
-	mtk_w32(eth, 0, MTK_QDMA_INT_MASK);
+	qdma_w32(mtk_mac_qdma(mac), 0, int_mask);
+}
+
+/* The NAPI contexts of engine n belong to the netdev of MAC n, that way
+ * the threaded setting of the netdev applies to them and busy polling
+ * sockets find them through the NAPI ID of each received skb.
+ */
+static void mtk_napi_add(struct qdma *qdma, struct net_device *dev)
+{
+	struct mtk_eth *eth = qdma->eth;
+
+	netif_napi_add(dev, &qdma->rx_napi, mtk_poll_rx);
+	netif_napi_add_tx(dev, &qdma->tx_napi, mtk_poll_tx);
+	netif_napi_set_irq(&qdma->rx_napi, eth->irq[MTK_IRQ_RX]);
+	netif_napi_set_irq(&qdma->tx_napi, eth->irq[MTK_IRQ_TX]);
+}
+
+static void mtk_napi_del(struct qdma *qdma)
+{
+	netif_napi_del(&qdma->rx_napi);
+	netif_napi_del(&qdma->tx_napi);
 }
 
 static int mtk_free_dev(struct mtk_eth *eth)
@@ -874,6 +2674,8 @@ static int mtk_free_dev(struct mtk_eth *eth)
 	for (i = 0; i < MTK_MAC_COUNT; i++) {
 		if (!eth->netdev[i])
 			continue;
+		mtk_napi_del(&eth->qdma[i]);
+		free_percpu(eth->mac[i]->stats);
 		free_netdev(eth->netdev[i]);
 	}
 
@@ -902,13 +2704,389 @@ static int mtk_cleanup(struct mtk_eth *eth)
 	return 0;
 }
 
+static int mtk_get_coalesce(struct net_device *dev,
+			    struct ethtool_coalesce *ec,
+			    struct kernel_ethtool_coalesce *kernel_coal,
+			    struct netlink_ext_ack *extack)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+
+	ec->rx_coalesce_usecs = eth->rx_coal_usecs;
+	ec->rx_max_coalesced_frames = eth->rx_coal_frames;
+	ec->tx_coalesce_usecs = eth->tx_coal_usecs;
+	ec->tx_max_coalesced_frames = eth->tx_coal_frames;
+	ec->use_adaptive_rx_coalesce = eth->rx_dim_enabled;
+	ec->use_adaptive_tx_coalesce = eth->tx_dim_enabled;
+
+	return 0;
+}
+
+static int mtk_set_coalesce(struct net_device *dev,
+			    struct ethtool_coalesce *ec,
+			    struct kernel_ethtool_coalesce *kernel_coal,
+			    struct netlink_ext_ack *extack)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+	u32 max_usecs, max_frames;
+
+	max_usecs = FIELD_MAX(QDLY_MAX_PTIME_MASK) * QDLY_PTIME_UNIT_US;
+	max_frames = FIELD_MAX(QDLY_MAX_PINT_MASK);
+
+	if (ec->rx_coalesce_usecs > max_usecs ||
+	    ec->tx_coalesce_usecs > max_usecs) {
+		NL_SET_ERR_MSG_FMT_MOD(extack, "usecs must be at most %u",
+				       max_usecs);
+		return -EINVAL;
+	}
+	if (ec->rx_max_coalesced_frames > max_frames ||
+	    ec->tx_max_coalesced_frames > max_frames) {
+		NL_SET_ERR_MSG_FMT_MOD(extack, "frames must be at most %u",
+				       max_frames);
+		return -EINVAL;
+	}
+
+	eth->rx_coal_usecs = ec->rx_coalesce_usecs;
+	eth->rx_coal_frames = ec->rx_max_coalesced_frames;
+	eth->tx_coal_usecs = ec->tx_coalesce_usecs;
+	eth->tx_coal_frames = ec->tx_max_coalesced_frames;
+	eth->rx_dim_enabled = ec->use_adaptive_rx_coalesce;
+	eth->tx_dim_enabled = ec->use_adaptive_tx_coalesce;
+
+	/* Otherwise it is programmed when the DMA is brought up */
+	if (refcount_read(&eth->dma_refcnt))
+		mtk_coal_apply(eth);
+
+	return 0;
+}
+
+/* A hardware MIB counter, 64 bit counters have the high word at +4 */
+struct mtk_mib_desc {
+	const char	*name;
+	u16		offset;
+	bool		is_64;
+};
+
+/* GDM counters, from MTK_GDM1_TX_GBCNT, MTK_STAT_OFFSET apart for each
+ * MAC. The layout is the one mtk_eth_soc uses for MT7621, they clear when
+ * read.
+ */
+static const struct mtk_mib_desc mtk_gdm_mib[] = {
+	{ "gdm_rx_bytes",		0x00, true },
+	{ "gdm_rx_packets",		0x08 },
+	{ "gdm_rx_overflow",		0x10 },
+	{ "gdm_rx_fcs_errors",		0x14 },
+	{ "gdm_rx_short_errors",	0x18 },
+	{ "gdm_rx_long_errors",		0x1c },
+	{ "gdm_rx_checksum_errors",	0x20 },
+	{ "gdm_rx_flow_control_packets", 0x24 },
+	{ "gdm_tx_skip",		0x28 },
+	{ "gdm_tx_collisions",		0x2c },
+	{ "gdm_tx_bytes",		0x30, true },
+	{ "gdm_tx_packets",		0x38 },
+};
+
+/* ERX crsn values, named after the MediaTek PPE CPU reasons. The rest are
+ * shown by number.
+ */
+static const char * const mtk_crsn_names[ERX_CRSN_COUNT] = {
+	[0x02] = "ttl_exceeded",
+	[0x03] = "option_header",
+	[0x07] = "no_flow",
+	[0x08] = "ipv4_frag",
+	[0x09] = "ipv4_dslite_frag",
+	[0x0a] = "ipv4_dslite_no_tcp_udp",
+	[0x0b] = "ipv6_6rd_no_tcp_udp",
+	[0x0c] = "tcp_fin_syn_rst",
+	[0x0d] = "un_hit",
+	[0x0e] = "hit_unbind",
+	[0x0f] = "hit_unbind_rate_reached",
+	[0x10] = "hit_bind_tcp_fin",
+	[0x11] = "hit_ttl_1",
+	[0x12] = "hit_bind_vlan_violation",
+	[0x13] = "keepalive_uc_old_hdr",
+	[0x14] = "keepalive_mc_new_hdr",
+	[0x15] = "keepalive_dup_old_hdr",
+	[0x16] = "hit_bind_force_cpu",
+	[0x17] = "tunnel_option_header",
+	[0x18] = "multicast_to_cpu",
+	[0x19] = "multicast_to_gmac1_cpu",
+	[0x1a] = "hit_pre_bind",
+	[0x1b] = "packet_sampling",
+	[0x1c] = "exceed_mtu",
+	[0x1e] = "ppe_bypass",
+	[0x1f] = "invalid",
+};
+
+/* Switch port counters, same as MT7530_PORT_MIB_COUNTER(). They run free
+ * and wrap so only the difference to the last read is added.
+ */
+#define GSW_PORT_MIB(port)		(GSW_BASE + 0x4000 + (port) * 0x100)
+#define GSW_MIB_PORTS			7
+
+static const struct mtk_mib_desc mtk_gsw_mib[] = {
+	{ "TxDrop",		0x00 },
+	{ "TxCrcErr",		0x04 },
+	{ "TxUnicast",		0x08 },
+	{ "TxMulticast",	0x0c },
+	{ "TxBroadcast",	0x10 },
+	{ "TxCollision",	0x14 },
+	{ "TxPause",		0x2c },
+	{ "TxBytes",		0x48, true },
+	{ "RxDrop",		0x60 },
+	{ "RxFiltering",	0x64 },
+	{ "RxUnicast",		0x68 },
+	{ "RxMulticast",	0x6c },
+	{ "RxBroadcast",	0x70 },
+	{ "RxAlignErr",		0x74 },
+	{ "RxCrcErr",		0x78 },
+	{ "RxUnderSizeErr",	0x7c },
+	{ "RxFragErr",		0x80 },
+	{ "RxOverSzErr",	0x84 },
+	{ "RxJabberErr",	0x88 },
+	{ "RxPause",		0x8c },
+	{ "RxBytes",		0xa8, true },
+	{ "RxCtrlDrop",		0xb0 },
+	{ "RxIngressDrop",	0xb4 },
+	{ "RxArlDrop",		0xb8 },
+};
+
+#define GSW_MIB_COUNT		(GSW_MIB_PORTS * ARRAY_SIZE(mtk_gsw_mib))
+
+/* Often enough that no 32 bit counter wraps twice, even at 2.5 Gbps */
+#define MTK_MIB_INTERVAL	(HZ)
+
+static u64 mtk_mib_read(struct mtk_eth *eth, u32 base,
+			const struct mtk_mib_desc *desc)
+{
+	u64 val = mtk_r32(eth, base + desc->offset);
+
+	if (desc->is_64)
+		val |= (u64)mtk_r32(eth, base + desc->offset + 4) << 32;
+	return val;
+}
+
+/* With DSA the MT7530 driver reports the switch counters itself */
+static bool mtk_mac_has_gsw_mib(struct mtk_mac *mac)
+{
+	return mac->id == 0 && !netdev_uses_dsa(mac->hw->netdev[0]);
+}
+
+/* Fold the hardware counters into the 64 bit software ones */
+static void mtk_mib_update(struct mtk_eth *eth)
+{
+	const struct mtk_mib_desc *desc;
+	struct mtk_mac *mac;
+	u64 val, *last;
+	u32 base;
+	int i, j, port;
+
+	mutex_lock(&eth->mib_lock);
+
+	for (i = 0; i < MTK_MAC_COUNT; i++) {
+		mac = eth->mac[i];
+		if (!mac)
+			continue;
+		base = MTK_GDM1_TX_GBCNT + mac->id * MTK_STAT_OFFSET;
+		for (j = 0; j < ARRAY_SIZE(mtk_gdm_mib); j++)
+			mac->gdm_mib[j] += mtk_mib_read(eth, base,
+							&mtk_gdm_mib[j]);
+	}
+
+	if (eth->mac[0] && mtk_mac_has_gsw_mib(eth->mac[0])) {
+		for (i = 0; i < GSW_MIB_COUNT; i++) {
+			port = i / ARRAY_SIZE(mtk_gsw_mib);
+			desc = &mtk_gsw_mib[i % ARRAY_SIZE(mtk_gsw_mib)];
+			last = &eth->gsw_mib_last[i];
+
+			val = mtk_mib_read(eth, GSW_PORT_MIB(port), desc);
+			if (desc->is_64)
+				eth->gsw_mib[i] += val - *last;
+			else
+				eth->gsw_mib[i] += (u32)(val - *last);
+			*last = val;
+		}
+	}
+
+	mutex_unlock(&eth->mib_lock);
+}
+
+static void mtk_mib_work(struct work_struct *work)
+{
+	struct mtk_eth *eth = container_of(to_delayed_work(work),
+					   struct mtk_eth, mib_work);
+
+	mtk_mib_update(eth);
+	schedule_delayed_work(&eth->mib_work, MTK_MIB_INTERVAL);
+}
+
+static int mtk_get_sset_count(struct net_device *dev, int sset)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	int count = ARRAY_SIZE(mtk_gdm_mib) + ERX_CRSN_COUNT + 1;
+
+	if (sset != ETH_SS_STATS)
+		return -EOPNOTSUPP;
+
+	if (mtk_mac_has_gsw_mib(mac))
+		count += GSW_MIB_COUNT;
+	return count;
+}
+
+static void mtk_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	int i;
+
+	if (sset != ETH_SS_STATS)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(mtk_gdm_mib); i++)
+		ethtool_puts(&data, mtk_gdm_mib[i].name);
+
+	for (i = 0; i < ERX_CRSN_COUNT; i++) {
+		if (mtk_crsn_names[i])
+			ethtool_sprintf(&data, "rx_cpu_reason_%s",
+					mtk_crsn_names[i]);
+		else
+			ethtool_sprintf(&data, "rx_cpu_reason_%d", i);
+	}
+	ethtool_puts(&data, "tx_done_list_stray");
+
+	if (!mtk_mac_has_gsw_mib(mac))
+		return;
+
+	for (i = 0; i < GSW_MIB_COUNT; i++)
+		ethtool_sprintf(&data, "p%d_%s", i / ARRAY_SIZE(mtk_gsw_mib),
+				mtk_gsw_mib[i % ARRAY_SIZE(mtk_gsw_mib)].name);
+}
+
+static void mtk_get_ethtool_stats(struct net_device *dev,
+				  struct ethtool_stats *stats, u64 *data)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+	struct qdma *qdma = &eth->qdma[mac->id];
+	u64 *crsn = data + ARRAY_SIZE(mtk_gdm_mib);
+	u64 *gsw = crsn + ERX_CRSN_COUNT + 1;
+	unsigned int start;
+	int i;
+
+	/* Whatever came in since the last time the work ran */
+	mtk_mib_update(eth);
+
+	mutex_lock(&eth->mib_lock);
+	memcpy(data, mac->gdm_mib, sizeof(u64) * ARRAY_SIZE(mtk_gdm_mib));
+	if (mtk_mac_has_gsw_mib(mac))
+		memcpy(gsw, eth->gsw_mib, sizeof(u64) * GSW_MIB_COUNT);
+	mutex_unlock(&eth->mib_lock);
+
+	crsn[ERX_CRSN_COUNT] = READ_ONCE(qdma->tx_done_stray);
+
+	do {
+		start = u64_stats_fetch_begin(&qdma->rx_crsn_syncp);
+		for (i = 0; i < ERX_CRSN_COUNT; i++)
+			crsn[i] = u64_stats_read(&qdma->rx_crsn[i]);
+	} while (u64_stats_fetch_retry(&qdma->rx_crsn_syncp, start));
+}
+
+static const struct ethtool_ops mtk_ethtool_ops = {
+	.supported_coalesce_params = ETHTOOL_COALESCE_USECS |
+				     ETHTOOL_COALESCE_MAX_FRAMES |
+				     ETHTOOL_COALESCE_USE_ADAPTIVE,
+	.get_link		= ethtool_op_get_link,
+	.get_coalesce		= mtk_get_coalesce,
+	.set_coalesce		= mtk_set_coalesce,
+	.get_strings		= mtk_get_strings,
+	.get_sset_count		= mtk_get_sset_count,
+	.get_ethtool_stats	= mtk_get_ethtool_stats,
+};
+
+/* Traffic class n is scheduled by the engine as QDMA queue n. The engine's
+ * per-queue shapers are not known so only the priority mapping can be
+ * offloaded.
+ */
+static int mtk_setup_tc_mqprio(struct net_device *dev,
+			       struct tc_mqprio_qopt_offload *mqprio)
+{
+	u8 num_tc = mqprio->qopt.num_tc;
+	int tc, err;
+
+	if (!num_tc) {
+		netdev_reset_tc(dev);
+		return netif_set_real_num_tx_queues(dev, MTK_QDMA_TX_QUEUES);
+	}
+
+	if (mqprio->mode != TC_MQPRIO_MODE_DCB) {
+		NL_SET_ERR_MSG_MOD(mqprio->extack, "Only dcb mode is supported");
+		return -EOPNOTSUPP;
+	}
+
+	if (mqprio->shaper != TC_MQPRIO_SHAPER_DCB) {
+		NL_SET_ERR_MSG_MOD(mqprio->extack,
+				   "Rate limiting is not supported");
+		return -EOPNOTSUPP;
+	}
+
+	if (num_tc > MTK_QDMA_TX_QUEUES) {
+		NL_SET_ERR_MSG_FMT_MOD(mqprio->extack,
+				       "At most %d traffic classes",
+				       MTK_QDMA_TX_QUEUES);
+		return -EINVAL;
+	}
+
+	err = netdev_set_num_tc(dev, num_tc);
+	if (err)
+		return err;
+
+	for (tc = 0; tc < num_tc; tc++) {
+		netdev_set_tc_queue(dev, tc, 1, tc);
+		mqprio->qopt.count[tc] = 1;
+		mqprio->qopt.offset[tc] = tc;
+	}
+	mqprio->qopt.hw = TC_MQPRIO_HW_OFFLOAD_TCS;
+
+	err = netif_set_real_num_tx_queues(dev, num_tc);
+	if (err)
+		netdev_reset_tc(dev);
+
+	return err;
+}
+
+static int mtk_setup_tc(struct net_device *dev, enum tc_setup_type type,
+			void *type_data)
+{
+	struct mtk_mac *mac = netdev_priv(dev);
+	struct mtk_eth *eth = mac->hw;
+
+	switch (type) {
+	case TC_SETUP_QDISC_MQPRIO:
+		return mtk_setup_tc_mqprio(dev, type_data);
+	case TC_SETUP_BLOCK:
+	case TC_SETUP_FT:
+		if (!eth->ppe)
+			return -EOPNOTSUPP;
+		return en75_ppe_setup_tc(eth->ppe, dev, type, type_data);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 static const struct net_device_ops mtk_netdev_ops = {
 	.ndo_init		= en75_init,
 	.ndo_uninit		= mtk_uninit,
 	.ndo_open		= mtk_open,
 	.ndo_stop		= mtk_stop,
 	.ndo_start_xmit		= mtk_start_xmit,
+	.ndo_select_queue	= mtk_select_queue,
+	.ndo_setup_tc		= mtk_setup_tc,
+	.ndo_bpf		= mtk_xdp,
+	.ndo_xdp_xmit		= mtk_xdp_xmit,
+	.ndo_xsk_wakeup		= mtk_xsk_wakeup,
 	.ndo_set_mac_address	= en75_set_mac_address,
+	.ndo_change_mtu		= mtk_change_mtu,
+	.ndo_get_stats64	= mtk_get_stats64,
 	.ndo_validate_addr	= eth_validate_addr,
 	.ndo_tx_timeout		= mtk_tx_timeout,
 };
@@ -930,14 +3108,24 @@ static int mtk_add_mac(struct mtk_eth *eth, struct device_node *np)
 		return -EINVAL;
 	}
 
+	/* Nothing points GDM2 at QDMA engine 1 so MAC 1 would never receive,
+	 * it stays off and engine 1 with it until that register is found.
+	 */
+	if (id != 0) {
+		dev_warn(eth->dev, "mac %d is not supported yet\n", id);
+		return 0;
+	}
+
 	if (eth->netdev[id]) {
 		dev_err(eth->dev, "duplicate mac id found: %d\n", id);
 		return -EINVAL;
 	}
 
-	eth->netdev[id] = alloc_etherdev(sizeof(*mac));
+	/* RX queue n is chain n, AF_XDP binds to QDMA_XSK_CHAIN by number */
+	eth->netdev[id] = alloc_etherdev_mqs(sizeof(*mac), MTK_QDMA_TX_QUEUES,
+					     NUM_QDMA_CHAINS);
 	if (!eth->netdev[id]) {
-		dev_err(eth->dev, "alloc_etherdev failed\n");
+		dev_err(eth->dev, "alloc_etherdev_mqs failed\n");
 		return -ENOMEM;
 	}
 	mac = netdev_priv(eth->netdev[id]);
@@ -946,19 +3134,158 @@ static int mtk_add_mac(struct mtk_eth *eth, struct device_node *np)
 	mac->hw = eth;
 	mac->of_node = np;
 
+	mac->stats = netdev_alloc_pcpu_stats(struct mtk_pcpu_stats);
+	if (!mac->stats)
+		goto err_free_netdev;
+
+	mac->gdm_mib = devm_kcalloc(eth->dev, ARRAY_SIZE(mtk_gdm_mib),
+				    sizeof(*mac->gdm_mib), GFP_KERNEL);
+	if (!mac->gdm_mib)
+		goto err_free_stats;
+
 	SET_NETDEV_DEV(eth->netdev[id], eth->dev);
+	eth->netdev[id]->hw_features = NETIF_F_SG | NETIF_F_IP_CSUM |
+				       NETIF_F_IPV6_CSUM | NETIF_F_RXCSUM |
+				       NETIF_F_HW_VLAN_CTAG_TX |
+				       NETIF_F_HW_VLAN_STAG_TX;
+	/* Both need the packets to go through the PPE, only GDM1's do */
+	if (eth->ppe && id == 0)
+		eth->netdev[id]->hw_features |= NETIF_F_HW_TC |
+						NETIF_F_RXHASH;
+	/* Tags which the engine strips have to be handed up either way, so
+	 * CTAG_RX can't be turned off.
+	 */
+	eth->netdev[id]->features |= eth->netdev[id]->hw_features |
+				     NETIF_F_HW_VLAN_CTAG_RX;
+	eth->netdev[id]->vlan_features = NETIF_F_SG | NETIF_F_IP_CSUM |
+					 NETIF_F_IPV6_CSUM;
 	eth->netdev[id]->watchdog_timeo = 5 * HZ;
 	eth->netdev[id]->netdev_ops = &mtk_netdev_ops;
+	eth->netdev[id]->ethtool_ops = &mtk_ethtool_ops;
 	eth->netdev[id]->base_addr = (unsigned long)eth->base;
 
 	eth->netdev[id]->irq = eth->irq[0];
 	eth->netdev[id]->dev.of_node = np;
 
-	eth->netdev[id]->max_mtu = MTK_MAX_RX_LENGTH - MTK_RX_ETH_HLEN;
+	if (id == 0)
+		eth->netdev[id]->max_mtu = MTK_MAX_RX_LENGTH_9K -
+					   MTK_RX_ETH_HLEN;
+	else
+		eth->netdev[id]->max_mtu = ETH_DATA_LEN;
+	eth->netdev[id]->xdp_features = NETDEV_XDP_ACT_BASIC |
+					NETDEV_XDP_ACT_REDIRECT |
+					NETDEV_XDP_ACT_NDO_XMIT |
+					NETDEV_XDP_ACT_XSK_ZEROCOPY;
+
+	mtk_napi_add(&eth->qdma[id], eth->netdev[id]);
+
+	return 0;
+
+	/* Nothing of the MAC is left for mtk_free_dev() to undo */
+err_free_stats:
+	free_percpu(mac->stats);
+err_free_netdev:
+	free_netdev(eth->netdev[id]);
+	eth->netdev[id] = NULL;
+	eth->mac[id] = NULL;
+	return -ENOMEM;
+}
+
+static void mtk_dsa_meta_free(struct mtk_eth *eth)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(eth->dsa_meta); i++) {
+		if (!eth->dsa_meta[i])
+			continue;
+		metadata_dst_free(eth->dsa_meta[i]);
+		eth->dsa_meta[i] = NULL;
+	}
+}
+
+/* One metadata dst per switch port, attached to received packets */
+static int mtk_dsa_meta_alloc(struct mtk_eth *eth)
+{
+	struct metadata_dst *md_dst;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(eth->dsa_meta); i++) {
+		md_dst = metadata_dst_alloc(0, METADATA_HW_PORT_MUX,
+					    GFP_KERNEL);
+		if (!md_dst) {
+			mtk_dsa_meta_free(eth);
+			return -ENOMEM;
+		}
+
+		md_dst->u.port_info.port_id = i;
+		eth->dsa_meta[i] = md_dst;
+	}
 
 	return 0;
 }
 
+/* Engine n sits 0x1000 after engine n - 1 and serves MAC n */
+static void mtk_qdma_init(struct mtk_eth *eth, int id)
+{
+	struct qdma *qdma = &eth->qdma[id];
+	struct qdma_chain *ch;
+	int i;
+
+	qdma->eth = eth;
+	qdma->id = id;
+	qdma->regs = eth->base + 0x4000 + id * 0x1000;
+	spin_lock_init(&qdma->irq_lock);
+	u64_stats_init(&qdma->rx_crsn_syncp);
+
+	for (i = 0; i < NUM_QDMA_CHAINS; i++) {
+		ch = &qdma->chains[i];
+		ch->qdma = qdma;
+		ch->id = i;
+		spin_lock_init(&ch->tx_lock);
+	}
+	qdma->chains[0].regs = &qdma->regs->qchain0;
+	qdma->chains[1].regs = &qdma->regs->qchain1;
+
+	INIT_WORK(&qdma->rx_dim.work, mtk_dim_rx);
+	qdma->rx_dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	INIT_WORK(&qdma->tx_dim.work, mtk_dim_tx);
+	qdma->tx_dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+
+	hrtimer_init(&qdma->tx_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	qdma->tx_timer.function = mtk_tx_timer;
+	qdma->tx_timer_usecs = MTK_TX_COAL_USECS;
+}
+
+/* RX and TX get a line each so that their affinity can be set apart, with
+ * a single line one handler does both.
+ */
+static int mtk_request_irqs(struct mtk_eth *eth)
+{
+	const char *name;
+	int err;
+
+	if (eth->irq[MTK_IRQ_TX] == eth->irq[MTK_IRQ_RX])
+		return devm_request_irq(eth->dev, eth->irq[MTK_IRQ_RX],
+					mtk_handle_irq, 0,
+					dev_name(eth->dev), eth);
+
+	name = devm_kasprintf(eth->dev, GFP_KERNEL, "%s-rx",
+			      dev_name(eth->dev));
+	if (!name)
+		return -ENOMEM;
+	err = devm_request_irq(eth->dev, eth->irq[MTK_IRQ_RX],
+			       mtk_handle_irq_rx, 0, name, eth);
+	if (err)
+		return err;
+
+	name = devm_kasprintf(eth->dev, GFP_KERNEL, "%s-tx",
+			      dev_name(eth->dev));
+	if (!name)
+		return -ENOMEM;
+	return devm_request_irq(eth->dev, eth->irq[MTK_IRQ_TX],
+				mtk_handle_irq_tx, 0, name, eth);
+}
+
 static int mtk_probe(struct platform_device *pdev)
 {
 	struct device_node *mac_np;
@@ -975,22 +3302,42 @@ static int mtk_probe(struct platform_device *pdev)
 		return PTR_ERR(eth->base);
 
 	spin_lock_init(&eth->page_lock);
-	spin_lock_init(&eth->tx_irq_lock);
-	spin_lock_init(&eth->rx_irq_lock);
+	mutex_init(&eth->mib_lock);
+	INIT_DELAYED_WORK(&eth->mib_work, mtk_mib_work);
+
+	eth->gsw_mib = devm_kcalloc(eth->dev, GSW_MIB_COUNT,
+				    sizeof(*eth->gsw_mib), GFP_KERNEL);
+	eth->gsw_mib_last = devm_kcalloc(eth->dev, GSW_MIB_COUNT,
+					 sizeof(*eth->gsw_mib_last),
+					 GFP_KERNEL);
+	if (!eth->gsw_mib || !eth->gsw_mib_last)
+		return -ENOMEM;
 
-	for (i = 0; i < 3; i++) {
-		if (i > 0)
-			eth->irq[i] = eth->irq[0];
-		else
-			eth->irq[i] = platform_get_irq(pdev, i);
-		if (eth->irq[i] < 0) {
-			dev_err(&pdev->dev, "no IRQ%d resource found\n", i);
-			return -ENXIO;
-		}
+	eth->irq[MTK_IRQ_RX] = platform_get_irq(pdev, MTK_IRQ_RX);
+	if (eth->irq[MTK_IRQ_RX] < 0) {
+		dev_err(&pdev->dev, "no IRQ%d resource found\n", MTK_IRQ_RX);
+		return -ENXIO;
 	}
+	/* Older device trees only list the one line */
+	eth->irq[MTK_IRQ_TX] = platform_get_irq_optional(pdev, MTK_IRQ_TX);
+	if (eth->irq[MTK_IRQ_TX] < 0)
+		eth->irq[MTK_IRQ_TX] = eth->irq[MTK_IRQ_RX];
 
 	eth->msg_enable = netif_msg_init(mtk_msg_level, MTK_DEFAULT_MSG_ENABLE);
 
+	for (i = 0; i < NUM_QDMA; i++)
+		mtk_qdma_init(eth, i);
+
+	/* Without the PPE everything still works, just in software */
+	eth->ppe = en75_ppe_init(eth->dev, eth->base, eth->netdev);
+	if (IS_ERR(eth->ppe)) {
+		dev_warn(eth->dev, "no flow offload: %pe\n", eth->ppe);
+		eth->ppe = NULL;
+	}
+
+	eth->tx_coal_usecs = MTK_TX_COAL_USECS;
+	eth->tx_coal_frames = MTK_TX_COAL_FRAMES;
+
 	for_each_child_of_node(pdev->dev.of_node, mac_np) {
 		if (!of_device_is_compatible(mac_np,
 					     "econet,eth-mac"))
@@ -1002,25 +3349,22 @@ static int mtk_probe(struct platform_device *pdev)
 		err = mtk_add_mac(eth, mac_np);
 		if (err) {
 			of_node_put(mac_np);
-			goto err_deinit_hw;
+			goto err_free_dev;
 		}
 	}
 
-	err = devm_request_irq(eth->dev, eth->irq[0],
-			       mtk_handle_irq, 0,
-			       dev_name(eth->dev), eth);
-		
+	err = mtk_request_irqs(eth);
 	if (err)
 		goto err_free_dev;
 
-#if 0
-	/* No MT7628/88 support yet */
-	if (!MTK_HAS_CAPS(eth->soc->caps, MTK_SOC_MT7628)) {
-		err = mtk_mdio_init(eth);
-		if (err)
-			goto err_free_dev;
-	}
-#endif
+	err = mtk_dsa_meta_alloc(eth);
+	if (err)
+		goto err_free_dev;
+
+	err = mtk_mdio_init(eth);
+	if (err)
+		goto err_deinit_mdio;
+
 	for (i = 0; i < MTK_MAX_DEVS; i++) {
 		if (!eth->netdev[i])
 			continue;
@@ -1037,14 +3381,17 @@ static int mtk_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, eth);
 
+	schedule_delayed_work(&eth->mib_work, MTK_MIB_INTERVAL);
+
 	return 0;
 
 err_deinit_mdio:
 	mtk_mdio_cleanup(eth);
+	mtk_dsa_meta_free(eth);
 err_free_dev:
 	mtk_free_dev(eth);
-err_deinit_hw:
 	mtk_hw_deinit(eth);
+	en75_ppe_deinit(eth->ppe);
 
 	return err;
 }
@@ -1055,6 +3402,8 @@ static void mtk_remove(struct platform_device *pdev)
 	struct mtk_mac *mac;
 	int i;
 
+	cancel_delayed_work_sync(&eth->mib_work);
+
 	/* stop all devices to make sure that dma is properly shut down */
 	for (i = 0; i < MTK_MAC_COUNT; i++) {
 		if (!eth->netdev[i])
@@ -1067,7 +3416,9 @@ static void mtk_remove(struct platform_device *pdev)
 	mtk_hw_deinit(eth);
 
 	mtk_cleanup(eth);
+	en75_ppe_deinit(eth->ppe);
 	mtk_mdio_cleanup(eth);
+	mtk_dsa_meta_free(eth);
 }
 
 static const struct of_device_id of_mtk_match[] = {
@@ -15,10 +15,15 @@
 #include <linux/u64_stats_sync.h>
 #include <linux/refcount.h>
 #include <linux/phylink.h>
+#include <linux/dim.h>
+#include <linux/hrtimer.h>
+#include <net/xdp.h>
 
 #include "econet_eth.h"
+#include "econet_eth_ppe.h"
 
 #define	MTK_MAX_RX_LENGTH	1536
+#define MTK_MAX_RX_LENGTH_9K	9216
 #define MTK_MAC_COUNT		2
 #define MTK_RX_ETH_HLEN		(VLAN_ETH_HLEN + VLAN_HLEN + ETH_FCS_LEN)
 #define MTK_DEFAULT_MSG_ENABLE	(NETIF_MSG_DRV | \
@@ -54,31 +59,187 @@ enum mtk_dev_state {
 #define MTK_MAX_DEVS			2
 
 struct mtk_mac;
+struct mtk_eth;
+struct mtk_tx_buf;
+struct mtk_rx_buf;
+struct page_pool;
+struct metadata_dst;
+
+/* One TX queue per QDMA queue, the queue field in the descriptor is 3 bits */
+#define MTK_QDMA_TX_QUEUES	8
+
+/* Interrupt lines in the order of the DT interrupts property, both carry
+ * the events of both engines. With only one line it is used for both.
+ */
+#define MTK_IRQ_RX		0
+#define MTK_IRQ_TX		1
+#define MTK_IRQ_COUNT		2
+
+/* Ports which fit in the 3 bit source port of the MT7530 special tag */
+#define MTK_DSA_PORTS		8
+
+/**
+ * qdma_chain - One TX ring and one RX ring of a QDMA engine
+ *
+ * @qdma: The engine which this chain belongs to
+ * @id: Chain number within the engine
+ * @regs: Ring registers of this chain
+ * @descs: TX descriptors followed by RX descriptors, shared with the hardware
+ * @descs_phys: DMA address of @descs
+ * @tx_lock: Every TX queue which lands on this chain shares @tx_ring
+ * @tx_ring: Protected by @tx_lock
+ * @tx_bufs: What each TX descriptor points at
+ * @rx_ring: Only touched from the NAPI poll
+ * @rx_bufs: What each RX descriptor points at
+ * @rx_page_pool: Where the RX buffers come from, unless @xsk_pool is set
+ * @xdp_rxq: What XDP programs see as the RX queue of this chain
+ * @xsk_pool: AF_XDP UMEM which fills the RX ring and feeds the TX ring
+ */
+struct qdma_chain {
+	struct qdma			*qdma;
+	int				id;
+	struct qchain_regs __iomem	*regs;
+	struct qdma_desc		*descs;
+	dma_addr_t			descs_phys;
+
+	spinlock_t			tx_lock;
+	struct qdma_ring		tx_ring;
+	struct mtk_tx_buf		*tx_bufs;
+
+	struct qdma_ring		rx_ring;
+	struct mtk_rx_buf		*rx_bufs;
+	struct page_pool		*rx_page_pool;
+	struct xdp_rxq_info		xdp_rxq;
+	struct xsk_buff_pool		*xsk_pool;
+};
+
+/**
+ * qdma - One QDMA engine, MAC n is served by engine n
+ *
+ * @eth: The frame engine
+ * @regs: Global registers of this engine
+ * @id: Engine number
+ * @enabled: The engine is in use, its MAC exists
+ * @irq_lock: RX and TX share one interrupt mask register
+ * @rx_napi: Drains the RX rings of every chain
+ * @tx_napi: Drains the Done List
+ * @tx_timer: Schedules @tx_napi while packets are in flight, TX0_DONE is
+ *            masked
+ * @tx_timer_usecs: Period of @tx_timer, follows the TX coalescing
+ * @chains: The chains of this engine
+ * @rx_buf_size: Size of every RX buffer, follows the MTU
+ * @rx_headroom: Room before the packet in every RX buffer
+ * @xdp_prog: XDP program run on every received packet, if any
+ * @xdp_xmit: ndo_xdp_xmit may use the TX chain, only while it is set up
+ * @irq_queue: TX Done List
+ * @hw_fwd_ary: Hardware forwarding descriptors
+ * @hw_fwd_buff: Hardware forwarding buffer
+ * @hw_fwd_payload: Hardware forwarding payload size, 2K << n
+ * @rx_dim: Adaptive RX interrupt moderation
+ * @tx_dim: Adaptive TX interrupt moderation
+ * @rx_crsn: Received packets by the PPE CPU reason in their descriptor,
+ *           only written by @rx_napi
+ * @rx_crsn_syncp: Protects @rx_crsn
+ * @tx_done_stray: Done List entries which named a descriptor that was not
+ *                 in flight or not written back, only written by @tx_napi
+ */
+struct qdma {
+	struct mtk_eth			*eth;
+	struct qregs __iomem		*regs;
+	int				id;
+	bool				enabled;
+	spinlock_t			irq_lock;
+	struct napi_struct		rx_napi;
+	struct napi_struct		tx_napi;
+	struct hrtimer			tx_timer;
+	u32				tx_timer_usecs;
+
+	struct qdma_chain		chains[NUM_QDMA_CHAINS];
+	u32				rx_buf_size;
+	u32				rx_headroom;
+	struct bpf_prog			*xdp_prog;
+	bool				xdp_xmit;
+
+	u32				*irq_queue;
+	dma_addr_t			irq_queue_phys;
+	void				*hw_fwd_ary;
+	dma_addr_t			hw_fwd_ary_phys;
+	void				*hw_fwd_buff;
+	dma_addr_t			hw_fwd_buff_phys;
+	u8				hw_fwd_payload;
+
+	struct dim			rx_dim;
+	struct dim			tx_dim;
+	u32				rx_events;
+	u32				rx_packets;
+	u32				rx_bytes;
+	u32				tx_events;
+	u32				tx_packets;
+	u32				tx_bytes;
+
+	u64_stats_t			rx_crsn[ERX_CRSN_COUNT];
+	struct u64_stats_sync		rx_crsn_syncp;
+	unsigned long			tx_done_stray;
+};
 
 struct mtk_eth {
 	struct device			*dev;
 	void __iomem			*base;
 	spinlock_t			page_lock;
-	spinlock_t			tx_irq_lock;
-	spinlock_t			rx_irq_lock;
 	struct net_device		*netdev[MTK_MAX_DEVS];
 	struct mtk_mac			*mac[MTK_MAX_DEVS];
-	int				irq[3];
+	int				irq[MTK_IRQ_COUNT];
 	u32				msg_enable;
 	refcount_t			dma_refcnt;
 
 	struct mii_bus			*mii_bus;
+	struct metadata_dst		*dsa_meta[MTK_DSA_PORTS];
 	struct work_struct		pending_work;
 	unsigned long			state;
 
+	struct qdma			qdma[NUM_QDMA];
+
+	/* Interrupt moderation for every engine, see qdma_delay_int_cfg */
+	u32				rx_coal_usecs;
+	u32				rx_coal_frames;
+	u32				tx_coal_usecs;
+	u32				tx_coal_frames;
+	bool				rx_dim_enabled;
+	bool				tx_dim_enabled;
+
+	/* Switch MIB counters of every port, see mtk_mib_update() */
+	struct mutex			mib_lock;
+	struct delayed_work		mib_work;
+	u64				*gsw_mib;
+	u64				*gsw_mib_last;
+
+	/* Flow offload, NULL if the PPE couldn't be set up */
+	struct en75_ppe			*ppe;
+
 	struct en75_debug		*debug;
-	// struct qdma			qdma[NUM_QDMA];
+};
+
+/* Traffic counters of a MAC for one CPU, see mtk_get_stats64() */
+struct mtk_pcpu_stats {
+	u64_stats_t			rx_packets;
+	u64_stats_t			rx_bytes;
+	u64_stats_t			rx_dropped;
+	u64_stats_t			tx_packets;
+	u64_stats_t			tx_bytes;
+	u64_stats_t			tx_dropped;
+	u64_stats_t			tx_errors;
+	struct u64_stats_sync		syncp;
 };
 
 struct mtk_mac {
 	int				id;
 	struct device_node		*of_node;
 	struct mtk_eth			*hw;
+	struct mtk_pcpu_stats __percpu	*stats;
+	/* GDM MIB counters, protected by the mib_lock of mtk_eth */
+	u64				*gdm_mib;
+	/* Descriptors in the TX ring per TX queue, protected by tx_lock */
+	u16				tx_inflight[MTK_QDMA_TX_QUEUES];
 };
 
 #endif /* MTK_ETH_H */
@@ -0,0 +1,840 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Packet Processing Engine, the hardware NAT / routing table of the frame
+ * engine. Flows which nftables or tc offload are written into the table
+ * as bound entries, from then on the PPE rewrites and forwards their
+ * packets without the CPU.
+ *
+ * Nothing here comes from EcoNet documentation, the register layout, the
+ * table layout and the hash are those of the MT7621 PPE which the frame
+ * engine descends from.
+ */
+#include <linux/bitfield.h>
+#include <linux/dma-mapping.h>
+#include <linux/etherdevice.h>
+#include <linux/iopoll.h>
+#include <linux/ip.h>
+#include <linux/rhashtable.h>
+#include <linux/unaligned.h>
+#include <net/dsa.h>
+#include <net/flow_offload.h>
+#include <net/pkt_cls.h>
+
+#include "econet_eth.h"
+#include "econet_eth_ppe.h"
+
+/* Free running seconds counter of the frame engine, bound entries are
+ * stamped from it when a packet hits them.
+ */
+#define FE_FOE_TS			0x0010
+
+#define PPE_BASE			0x0c00
+
+#define PPE_GLO_CFG			0x200
+#define PPE_GLO_CFG_BUSY		BIT(31)
+#define PPE_GLO_CFG_FLOW_DROP_UPDATE	BIT(9)
+#define PPE_GLO_CFG_IP4_CS_DROP		BIT(3)
+#define PPE_GLO_CFG_IP4_L4_CS_DROP	BIT(2)
+#define PPE_GLO_CFG_EN			BIT(0)
+
+#define PPE_FLOW_CFG			0x204
+#define PPE_FLOW_CFG_IP4_NAPT		BIT(13)
+#define PPE_FLOW_CFG_IP4_NAT		BIT(12)
+
+#define PPE_IP_PROTO_CHK		0x208
+#define PPE_IP_PROTO_CHK_IPV4		GENMASK(15, 0)
+
+#define PPE_TB_CFG			0x21c
+#define PPE_TB_CFG_SCAN_MODE		GENMASK(17, 16)
+#define PPE_TB_CFG_HASH_MODE		GENMASK(15, 14)
+#define PPE_TB_CFG_KEEPALIVE		GENMASK(13, 12)
+#define PPE_TB_CFG_SEARCH_MISS		GENMASK(5, 4)
+#define PPE_TB_CFG_ENTRY_80B		BIT(3)
+#define PPE_TB_CFG_ENTRY_NUM		GENMASK(2, 0)
+
+/* Packets without a bound entry go on to the CPU, the PPE doesn't learn
+ * entries of its own. Nor does it age them, the flowtable times flows out
+ * from their last use and removes them, a flow which the hardware dropped
+ * would never be offloaded again.
+ */
+#define PPE_SEARCH_MISS_FORWARD		1
+#define PPE_SCAN_MODE_DISABLED		0
+#define PPE_KEEPALIVE_DISABLE		0
+
+#define PPE_TB_BASE			0x220
+
+#define PPE_DEFAULT_CPU_PORT		0x248
+
+#define PPE_CACHE_CTL			0x320
+#define PPE_CACHE_CTL_CLEAR		BIT(9)
+#define PPE_CACHE_CTL_EN		BIT(0)
+
+/* 1024 << n entries, the RX descriptor has 14 bits for the entry index */
+#define PPE_ENTRIES_SHIFT		2
+#define PPE_ENTRIES			(1024 << PPE_ENTRIES_SHIFT)
+
+#define FOE_IB1_UDP			BIT(30)
+#define FOE_IB1_STATE			GENMASK(29, 28)
+#define FOE_IB1_PACKET_TYPE		GENMASK(27, 25)
+#define FOE_IB1_BIND_TTL		BIT(24)
+#define FOE_IB1_BIND_CACHE		BIT(22)
+#define FOE_IB1_BIND_VLAN_TAG		BIT(20)
+#define FOE_IB1_BIND_VLAN_LAYER		GENMASK(18, 16)
+#define FOE_IB1_BIND_TIMESTAMP		GENMASK(14, 0)
+
+enum foe_state {
+	FOE_STATE_INVALID		= 0,
+	FOE_STATE_UNBIND		= 1,
+	FOE_STATE_BIND			= 2,
+	FOE_STATE_STATIC		= 3,
+};
+
+#define FOE_PKT_TYPE_IPV4_HNAPT		0
+
+#define FOE_IB2_PORT_AG			GENMASK(23, 18)
+#define FOE_IB2_PORT_MG			GENMASK(17, 12)
+/* Where a bound packet goes, an ETX_FPORT value */
+#define FOE_IB2_DEST_PORT		GENMASK(7, 5)
+
+/* Words which hold two 16 bit fields, ports are source port high */
+#define FOE_HI16			GENMASK(31, 16)
+#define FOE_LO16			GENMASK(15, 0)
+
+/**
+ * en75_foe_ipv4 - IPv4 NAPT entry, everything past ib1
+ *
+ * @orig_sip: Source address which the entry matches
+ * @orig_dip: Destination address which the entry matches
+ * @orig_ports: Source and destination port which the entry matches
+ * @ib2: Where the packet goes, see FOE_IB2_*
+ * @new_sip: Source address after NAT
+ * @new_dip: Destination address after NAT
+ * @new_ports: Ports after NAT
+ * @etype_vlan1: Ethertype, or DSA port mask, and the outer VLAN
+ * @dmac_hi: First four bytes of the destination MAC
+ * @dmac_lo_vlan2: Last two bytes of the destination MAC and the inner VLAN
+ * @smac_hi: First four bytes of the source MAC
+ * @smac_lo_pppoe: Last two bytes of the source MAC and the PPPoE session
+ */
+struct en75_foe_ipv4 {
+	u32 orig_sip;
+	u32 orig_dip;
+	u32 orig_ports;
+	u32 ib2;
+	u32 new_sip;
+	u32 new_dip;
+	u32 new_ports;
+	u32 timestamp;
+	u32 unused_0;
+	u32 udf_tsid;
+	u32 etype_vlan1;
+	u32 dmac_hi;
+	u32 dmac_lo_vlan2;
+	u32 smac_hi;
+	u32 smac_lo_pppoe;
+};
+
+struct en75_foe_entry {
+	u32 ib1;
+	union {
+		struct en75_foe_ipv4 ipv4;
+		u32 data[19];
+	};
+};
+
+_Static_assert(sizeof(struct en75_foe_entry) == 80, "foe entry size");
+
+/* One offloaded flow, found by the cookie which the flow API gives it */
+struct en75_flow {
+	struct rhash_head node;
+	unsigned long cookie;
+	u16 hash;
+};
+
+static const struct rhashtable_params en75_flow_ht_params = {
+	.head_offset = offsetof(struct en75_flow, node),
+	.key_offset = offsetof(struct en75_flow, cookie),
+	.key_len = sizeof(unsigned long),
+	.automatic_shrinking = true,
+};
+
+/**
+ * en75_ppe - The Packet Processing Engine
+ *
+ * @base: PPE registers
+ * @fe_base: Frame engine registers, for the timestamp
+ * @netdev: The MAC netdevs, a flow can only leave through one of them
+ * @foe_table: The flow table, shared with the hardware
+ * @foe_phys: DMA address of @foe_table
+ * @foe_used: Entries which belong to a flow
+ * @flows: Every offloaded flow
+ * @flow_lock: Serializes changes to @flows and @foe_table
+ */
+struct en75_ppe {
+	void __iomem *base;
+	void __iomem *fe_base;
+	struct net_device **netdev;
+	struct en75_foe_entry *foe_table;
+	dma_addr_t foe_phys;
+	unsigned long *foe_used;
+	struct rhashtable flows;
+	struct mutex flow_lock;
+};
+
+/* What a flow rule says about the packets after the rewrite */
+struct en75_flow_data {
+	struct ethhdr eth;
+	__be32 src_addr;
+	__be32 dst_addr;
+	__be16 src_port;
+	__be16 dst_port;
+	u16 vlan_id;
+	u8 vlan_num;
+};
+
+static u32 ppe_r32(struct en75_ppe *ppe, u32 reg)
+{
+	return __raw_readl(ppe->base + reg);
+}
+
+static void ppe_w32(struct en75_ppe *ppe, u32 val, u32 reg)
+{
+	__raw_writel(val, ppe->base + reg);
+}
+
+static void ppe_m32(struct en75_ppe *ppe, u32 reg, u32 clear, u32 set)
+{
+	ppe_w32(ppe, (ppe_r32(ppe, reg) & ~clear) | set, reg);
+}
+
+static u16 en75_ppe_timestamp(struct en75_ppe *ppe)
+{
+	return __raw_readl(ppe->fe_base + FE_FOE_TS) & FOE_IB1_BIND_TIMESTAMP;
+}
+
+/* The hardware looks entries up with the same hash, an entry can go in
+ * the slot it hashes to or the one after.
+ */
+static u32 en75_ppe_hash(const struct en75_foe_entry *e)
+{
+	u32 hv1 = e->ipv4.orig_ports;
+	u32 hv2 = e->ipv4.orig_dip;
+	u32 hv3 = e->ipv4.orig_sip;
+	u32 hash;
+
+	hash = (hv1 & hv2) | ((~hv1) & hv3);
+	hash = (hash >> 24) | ((hash & 0xffffff) << 8);
+	hash ^= hv1 ^ hv2 ^ hv3;
+	hash ^= hash >> 16;
+	hash <<= 1;
+
+	return hash & (PPE_ENTRIES - 1);
+}
+
+/* The table itself is uncached, only the PPE's own copy has to go */
+static void en75_ppe_cache_clear(struct en75_ppe *ppe)
+{
+	ppe_m32(ppe, PPE_CACHE_CTL, 0, PPE_CACHE_CTL_CLEAR);
+	ppe_m32(ppe, PPE_CACHE_CTL, PPE_CACHE_CTL_CLEAR, 0);
+}
+
+/* Write a bound entry into a free slot of its hash bucket.
+ *
+ * Returns: the index of the entry or -ENOSPC
+ */
+static int en75_ppe_foe_commit(struct en75_ppe *ppe,
+			       struct en75_foe_entry *entry)
+{
+	struct en75_foe_entry *hwe;
+	u32 hash;
+
+	entry->ib1 = u32_replace_bits(entry->ib1, en75_ppe_timestamp(ppe),
+				      FOE_IB1_BIND_TIMESTAMP);
+
+	hash = en75_ppe_hash(entry);
+	if (test_bit(hash, ppe->foe_used)) {
+		hash++;
+		if (test_bit(hash, ppe->foe_used))
+			return -ENOSPC;
+	}
+	hwe = &ppe->foe_table[hash];
+
+	/* The hardware must not see a bound entry before all of it */
+	memcpy(&hwe->data, &entry->data, sizeof(hwe->data));
+	wmb();
+	hwe->ib1 = entry->ib1;
+	wmb();
+
+	set_bit(hash, ppe->foe_used);
+	en75_ppe_cache_clear(ppe);
+
+	return hash;
+}
+
+static void en75_ppe_foe_clear(struct en75_ppe *ppe, u16 hash)
+{
+	ppe->foe_table[hash].ib1 = FIELD_PREP(FOE_IB1_STATE, FOE_STATE_INVALID);
+	wmb();
+	clear_bit(hash, ppe->foe_used);
+	en75_ppe_cache_clear(ppe);
+}
+
+static void en75_foe_prepare(struct en75_foe_entry *foe, u8 l4proto,
+			     const u8 *src_mac, const u8 *dest_mac)
+{
+	struct en75_foe_ipv4 *e = &foe->ipv4;
+
+	memset(foe, 0, sizeof(*foe));
+	foe->ib1 = FIELD_PREP(FOE_IB1_STATE, FOE_STATE_BIND) |
+		   FIELD_PREP(FOE_IB1_PACKET_TYPE, FOE_PKT_TYPE_IPV4_HNAPT) |
+		   (l4proto == IPPROTO_UDP ? FOE_IB1_UDP : 0) |
+		   FOE_IB1_BIND_TTL | FOE_IB1_BIND_CACHE;
+
+	e->ib2 = FIELD_PREP(FOE_IB2_PORT_MG, 0x3f) |
+		 FIELD_PREP(FOE_IB2_PORT_AG, 0x1f);
+
+	e->etype_vlan1 = FIELD_PREP(FOE_HI16, ETH_P_IP);
+	e->dmac_hi = get_unaligned_be32(dest_mac);
+	e->dmac_lo_vlan2 = FIELD_PREP(FOE_HI16,
+				      get_unaligned_be16(dest_mac + 4));
+	e->smac_hi = get_unaligned_be32(src_mac);
+	e->smac_lo_pppoe = FIELD_PREP(FOE_HI16,
+				      get_unaligned_be16(src_mac + 4));
+}
+
+static void en75_foe_set_tuple(struct en75_foe_entry *foe, bool egress,
+			       const struct en75_flow_data *data)
+{
+	struct en75_foe_ipv4 *e = &foe->ipv4;
+	u32 ports = FIELD_PREP(FOE_HI16, be16_to_cpu(data->src_port)) |
+		    FIELD_PREP(FOE_LO16, be16_to_cpu(data->dst_port));
+
+	if (egress) {
+		e->new_sip = be32_to_cpu(data->src_addr);
+		e->new_dip = be32_to_cpu(data->dst_addr);
+		e->new_ports = ports;
+	} else {
+		e->orig_sip = be32_to_cpu(data->src_addr);
+		e->orig_dip = be32_to_cpu(data->dst_addr);
+		e->orig_ports = ports;
+	}
+}
+
+static int en75_foe_set_vlan(struct en75_foe_entry *foe, u16 vid)
+{
+	struct en75_foe_ipv4 *e = &foe->ipv4;
+
+	switch (FIELD_GET(FOE_IB1_BIND_VLAN_LAYER, foe->ib1)) {
+	case 0:
+		foe->ib1 |= FOE_IB1_BIND_VLAN_TAG |
+			    FIELD_PREP(FOE_IB1_BIND_VLAN_LAYER, 1);
+		e->etype_vlan1 = u32_replace_bits(e->etype_vlan1, vid,
+						  FOE_LO16);
+		return 0;
+	case 1:
+		if (!(foe->ib1 & FOE_IB1_BIND_VLAN_TAG)) {
+			e->etype_vlan1 = u32_replace_bits(e->etype_vlan1, vid,
+							  FOE_LO16);
+			e->etype_vlan1 |= FIELD_PREP(FOE_HI16, BIT(8));
+		} else {
+			e->dmac_lo_vlan2 = u32_replace_bits(e->dmac_lo_vlan2,
+							    vid, FOE_LO16);
+			foe->ib1 += FIELD_PREP(FOE_IB1_BIND_VLAN_LAYER, 1);
+		}
+		return 0;
+	default:
+		return -ENOSPC;
+	}
+}
+
+/* The switch port goes out as a special tag, which the PPE counts as a
+ * VLAN layer with the port mask in place of the ethertype.
+ */
+static void en75_foe_set_dsa(struct en75_foe_entry *foe, int port)
+{
+	struct en75_foe_ipv4 *e = &foe->ipv4;
+	u16 etype = BIT(port);
+
+	if (!(foe->ib1 & FOE_IB1_BIND_VLAN_LAYER))
+		foe->ib1 |= FIELD_PREP(FOE_IB1_BIND_VLAN_LAYER, 1);
+	else
+		etype |= BIT(8);
+
+	e->etype_vlan1 = u32_replace_bits(e->etype_vlan1, etype, FOE_HI16);
+	foe->ib1 &= ~FOE_IB1_BIND_VLAN_TAG;
+}
+
+/* Which MAC a netdev is and, for a DSA user port, which switch port.
+ *
+ * Returns: the ETX_FPORT of the MAC or -EOPNOTSUPP if it isn't ours
+ */
+static int en75_ppe_dev_port(struct en75_ppe *ppe, struct net_device *dev,
+			     int *dsa_port)
+{
+	*dsa_port = -1;
+
+#if IS_ENABLED(CONFIG_NET_DSA)
+	{
+		struct dsa_port *dp = dsa_port_from_netdev(dev);
+
+		if (!IS_ERR(dp)) {
+			if (dp->cpu_dp->tag_ops->proto != DSA_TAG_PROTO_MTK)
+				return -EOPNOTSUPP;
+			*dsa_port = dp->index;
+			dev = dsa_port_to_conduit(dp);
+		}
+	}
+#endif
+
+	if (dev == ppe->netdev[0])
+		return ETX_FPORT_LAN;
+	if (dev == ppe->netdev[1])
+		return ETX_FPORT_WAN;
+	return -EOPNOTSUPP;
+}
+
+/* The flow API mangles the header as host order words, the mask keeps
+ * the bits which aren't rewritten.
+ */
+static int en75_flow_mangle_eth(const struct flow_action_entry *act,
+				struct ethhdr *eth)
+{
+	u8 *dest = (u8 *)eth + act->mangle.offset;
+	u32 val;
+
+	if (act->mangle.offset > sizeof(*eth) - sizeof(val))
+		return -EINVAL;
+
+	memcpy(&val, dest, sizeof(val));
+	val = (val & act->mangle.mask) | (act->mangle.val & ~act->mangle.mask);
+	memcpy(dest, &val, sizeof(val));
+	return 0;
+}
+
+static int en75_flow_mangle_ports(const struct flow_action_entry *act,
+				  struct en75_flow_data *data)
+{
+	u32 val = ntohl(act->mangle.val);
+
+	switch (act->mangle.offset) {
+	case 0:
+		if (act->mangle.mask == ~htonl(0xffff))
+			data->dst_port = cpu_to_be16(val);
+		else
+			data->src_port = cpu_to_be16(val >> 16);
+		return 0;
+	case 2:
+		data->dst_port = cpu_to_be16(val);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static int en75_flow_mangle_ipv4(const struct flow_action_entry *act,
+				 struct en75_flow_data *data)
+{
+	switch (act->mangle.offset) {
+	case offsetof(struct iphdr, saddr):
+		memcpy(&data->src_addr, &act->mangle.val, sizeof(u32));
+		return 0;
+	case offsetof(struct iphdr, daddr):
+		memcpy(&data->dst_addr, &act->mangle.val, sizeof(u32));
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Only GDM1 sends its packets through the PPE, so only flows which come
+ * in on the first MAC or a switch port behind it can ever hit. Either MAC
+ * is fine to leave through.
+ */
+static bool en75_ppe_ingress_ok(struct en75_ppe *ppe, int ifindex)
+{
+	struct net_device *dev;
+	int dsa_port;
+	bool ok;
+
+	rcu_read_lock();
+	dev = dev_get_by_index_rcu(&init_net, ifindex);
+	ok = dev && en75_ppe_dev_port(ppe, dev, &dsa_port) == ETX_FPORT_LAN;
+	rcu_read_unlock();
+
+	return ok;
+}
+
+/* Only IPv4 TCP and UDP flows, with NAT or without, are offloaded */
+static int en75_ppe_flow_replace(struct en75_ppe *ppe,
+				 struct flow_cls_offload *f)
+{
+	struct flow_rule *rule = flow_cls_offload_flow_rule(f);
+	struct en75_flow_data data = {};
+	struct flow_action_entry *act;
+	struct net_device *odev = NULL;
+	struct en75_foe_entry foe;
+	struct en75_flow *flow;
+	int fport, dsa_port, hash, err, i;
+	u16 addr_type;
+	u8 l4proto;
+
+	if (rhashtable_lookup(&ppe->flows, &f->cookie, en75_flow_ht_params))
+		return -EEXIST;
+
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_META)) {
+		struct flow_match_meta match;
+
+		flow_rule_match_meta(rule, &match);
+		if (!en75_ppe_ingress_ok(ppe, match.key->ingress_ifindex))
+			return -EOPNOTSUPP;
+	} else {
+		return -EOPNOTSUPP;
+	}
+
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_CONTROL)) {
+		struct flow_match_control match;
+
+		flow_rule_match_control(rule, &match);
+		addr_type = match.key->addr_type;
+	} else {
+		return -EOPNOTSUPP;
+	}
+	if (addr_type != FLOW_DISSECTOR_KEY_IPV4_ADDRS)
+		return -EOPNOTSUPP;
+
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_BASIC)) {
+		struct flow_match_basic match;
+
+		flow_rule_match_basic(rule, &match);
+		l4proto = match.key->ip_proto;
+	} else {
+		return -EOPNOTSUPP;
+	}
+	if (l4proto != IPPROTO_TCP && l4proto != IPPROTO_UDP)
+		return -EOPNOTSUPP;
+
+	/* The MACs are needed up front, everything else is applied after
+	 * the original tuple is in place.
+	 */
+	flow_action_for_each(i, act, &rule->action) {
+		switch (act->id) {
+		case FLOW_ACTION_MANGLE:
+			if (act->mangle.htype == FLOW_ACT_MANGLE_HDR_TYPE_ETH) {
+				err = en75_flow_mangle_eth(act, &data.eth);
+				if (err)
+					return err;
+			}
+			break;
+		case FLOW_ACTION_REDIRECT:
+			odev = act->dev;
+			break;
+		case FLOW_ACTION_CSUM:
+			break;
+		case FLOW_ACTION_VLAN_PUSH:
+			if (data.vlan_num ||
+			    act->vlan.proto != htons(ETH_P_8021Q))
+				return -EOPNOTSUPP;
+			data.vlan_id = act->vlan.vid;
+			data.vlan_num++;
+			break;
+		case FLOW_ACTION_VLAN_POP:
+			break;
+		default:
+			return -EOPNOTSUPP;
+		}
+	}
+
+	if (!odev)
+		return -EOPNOTSUPP;
+	if (!is_valid_ether_addr(data.eth.h_source) ||
+	    !is_valid_ether_addr(data.eth.h_dest))
+		return -EINVAL;
+
+	en75_foe_prepare(&foe, l4proto, data.eth.h_source, data.eth.h_dest);
+
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_PORTS)) {
+		struct flow_match_ports match;
+
+		flow_rule_match_ports(rule, &match);
+		data.src_port = match.key->src;
+		data.dst_port = match.key->dst;
+	} else {
+		return -EOPNOTSUPP;
+	}
+
+	if (flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_IPV4_ADDRS)) {
+		struct flow_match_ipv4_addrs match;
+
+		flow_rule_match_ipv4_addrs(rule, &match);
+		data.src_addr = match.key->src;
+		data.dst_addr = match.key->dst;
+	} else {
+		return -EOPNOTSUPP;
+	}
+	en75_foe_set_tuple(&foe, false, &data);
+
+	flow_action_for_each(i, act, &rule->action) {
+		if (act->id != FLOW_ACTION_MANGLE)
+			continue;
+
+		switch (act->mangle.htype) {
+		case FLOW_ACT_MANGLE_HDR_TYPE_TCP:
+		case FLOW_ACT_MANGLE_HDR_TYPE_UDP:
+			err = en75_flow_mangle_ports(act, &data);
+			break;
+		case FLOW_ACT_MANGLE_HDR_TYPE_IP4:
+			err = en75_flow_mangle_ipv4(act, &data);
+			break;
+		case FLOW_ACT_MANGLE_HDR_TYPE_ETH:
+			err = 0;
+			break;
+		default:
+			return -EOPNOTSUPP;
+		}
+		if (err)
+			return err;
+	}
+	en75_foe_set_tuple(&foe, true, &data);
+
+	if (data.vlan_num) {
+		err = en75_foe_set_vlan(&foe, data.vlan_id);
+		if (err)
+			return err;
+	}
+
+	fport = en75_ppe_dev_port(ppe, odev, &dsa_port);
+	if (fport < 0)
+		return fport;
+	if (dsa_port >= 0)
+		en75_foe_set_dsa(&foe, dsa_port);
+	foe.ipv4.ib2 = u32_replace_bits(foe.ipv4.ib2, fport,
+					FOE_IB2_DEST_PORT);
+
+	flow = kzalloc(sizeof(*flow), GFP_KERNEL);
+	if (!flow)
+		return -ENOMEM;
+	flow->cookie = f->cookie;
+
+	hash = en75_ppe_foe_commit(ppe, &foe);
+	if (hash < 0) {
+		err = hash;
+		goto err_free;
+	}
+	flow->hash = hash;
+
+	err = rhashtable_insert_fast(&ppe->flows, &flow->node,
+				     en75_flow_ht_params);
+	if (err)
+		goto err_clear;
+
+	return 0;
+
+err_clear:
+	en75_ppe_foe_clear(ppe, hash);
+err_free:
+	kfree(flow);
+	return err;
+}
+
+static int en75_ppe_flow_destroy(struct en75_ppe *ppe,
+				 struct flow_cls_offload *f)
+{
+	struct en75_flow *flow;
+
+	flow = rhashtable_lookup(&ppe->flows, &f->cookie, en75_flow_ht_params);
+	if (!flow)
+		return -ENOENT;
+
+	en75_ppe_foe_clear(ppe, flow->hash);
+	rhashtable_remove_fast(&ppe->flows, &flow->node, en75_flow_ht_params);
+	kfree(flow);
+
+	return 0;
+}
+
+/* There are no counters per entry, only when the last packet hit it */
+static int en75_ppe_flow_stats(struct en75_ppe *ppe,
+			       struct flow_cls_offload *f)
+{
+	struct en75_flow *flow;
+	u16 idle;
+	u32 ib1;
+
+	flow = rhashtable_lookup(&ppe->flows, &f->cookie, en75_flow_ht_params);
+	if (!flow)
+		return -ENOENT;
+
+	/* Not bound any more, its packets go through the CPU again */
+	ib1 = READ_ONCE(ppe->foe_table[flow->hash].ib1);
+	if (FIELD_GET(FOE_IB1_STATE, ib1) != FOE_STATE_BIND)
+		return -ETIMEDOUT;
+
+	idle = (en75_ppe_timestamp(ppe) -
+		FIELD_GET(FOE_IB1_BIND_TIMESTAMP, ib1)) & FOE_IB1_BIND_TIMESTAMP;
+	f->stats.lastused = jiffies - idle * HZ;
+
+	return 0;
+}
+
+static int en75_ppe_block_cb(enum tc_setup_type type, void *type_data,
+			     void *cb_priv)
+{
+	struct flow_cls_offload *cls = type_data;
+	struct en75_ppe *ppe = cb_priv;
+	int err;
+
+	if (type != TC_SETUP_CLSFLOWER)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&ppe->flow_lock);
+	switch (cls->command) {
+	case FLOW_CLS_REPLACE:
+		err = en75_ppe_flow_replace(ppe, cls);
+		break;
+	case FLOW_CLS_DESTROY:
+		err = en75_ppe_flow_destroy(ppe, cls);
+		break;
+	case FLOW_CLS_STATS:
+		err = en75_ppe_flow_stats(ppe, cls);
+		break;
+	default:
+		err = -EOPNOTSUPP;
+		break;
+	}
+	mutex_unlock(&ppe->flow_lock);
+
+	return err;
+}
+
+int en75_ppe_setup_tc(struct en75_ppe *ppe, struct net_device *dev,
+		      enum tc_setup_type type, void *type_data)
+{
+	static LIST_HEAD(block_cb_list);
+	struct flow_block_offload *f = type_data;
+	struct flow_block_cb *block_cb;
+
+	if (type != TC_SETUP_BLOCK && type != TC_SETUP_FT)
+		return -EOPNOTSUPP;
+	if (f->binder_type != FLOW_BLOCK_BINDER_TYPE_CLSACT_INGRESS)
+		return -EOPNOTSUPP;
+
+	f->driver_block_list = &block_cb_list;
+
+	switch (f->command) {
+	case FLOW_BLOCK_BIND:
+		if (!tc_can_offload(dev))
+			return -EOPNOTSUPP;
+
+		block_cb = flow_block_cb_lookup(f->block, en75_ppe_block_cb,
+						dev);
+		if (block_cb) {
+			flow_block_cb_incref(block_cb);
+			return 0;
+		}
+		block_cb = flow_block_cb_alloc(en75_ppe_block_cb, dev, ppe,
+					       NULL);
+		if (IS_ERR(block_cb))
+			return PTR_ERR(block_cb);
+
+		flow_block_cb_incref(block_cb);
+		flow_block_cb_add(block_cb, f);
+		list_add_tail(&block_cb->driver_list, &block_cb_list);
+		return 0;
+	case FLOW_BLOCK_UNBIND:
+		block_cb = flow_block_cb_lookup(f->block, en75_ppe_block_cb,
+						dev);
+		if (!block_cb)
+			return -ENOENT;
+
+		if (!flow_block_cb_decref(block_cb)) {
+			flow_block_cb_remove(block_cb, f);
+			list_del(&block_cb->driver_list);
+		}
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+/* Entries which were bound before a stop are still in the table and
+ * still belong to their flows.
+ */
+void en75_ppe_start(struct en75_ppe *ppe)
+{
+	ppe_w32(ppe, ppe->foe_phys, PPE_TB_BASE);
+
+	ppe_w32(ppe, PPE_TB_CFG_ENTRY_80B |
+		FIELD_PREP(PPE_TB_CFG_SEARCH_MISS, PPE_SEARCH_MISS_FORWARD) |
+		FIELD_PREP(PPE_TB_CFG_KEEPALIVE, PPE_KEEPALIVE_DISABLE) |
+		FIELD_PREP(PPE_TB_CFG_HASH_MODE, 1) |
+		FIELD_PREP(PPE_TB_CFG_SCAN_MODE, PPE_SCAN_MODE_DISABLED) |
+		FIELD_PREP(PPE_TB_CFG_ENTRY_NUM, PPE_ENTRIES_SHIFT),
+		PPE_TB_CFG);
+
+	ppe_w32(ppe, PPE_IP_PROTO_CHK_IPV4, PPE_IP_PROTO_CHK);
+	ppe_m32(ppe, PPE_CACHE_CTL, 0, PPE_CACHE_CTL_EN);
+	en75_ppe_cache_clear(ppe);
+
+	ppe_w32(ppe, PPE_FLOW_CFG_IP4_NAT | PPE_FLOW_CFG_IP4_NAPT,
+		PPE_FLOW_CFG);
+
+	ppe_w32(ppe, 0, PPE_DEFAULT_CPU_PORT);
+
+	ppe_w32(ppe, PPE_GLO_CFG_EN | PPE_GLO_CFG_IP4_L4_CS_DROP |
+		PPE_GLO_CFG_IP4_CS_DROP | PPE_GLO_CFG_FLOW_DROP_UPDATE,
+		PPE_GLO_CFG);
+}
+
+int en75_ppe_stop(struct en75_ppe *ppe)
+{
+	u32 val;
+
+	ppe_m32(ppe, PPE_CACHE_CTL, PPE_CACHE_CTL_EN, 0);
+	ppe_m32(ppe, PPE_GLO_CFG, PPE_GLO_CFG_EN, 0);
+	ppe_w32(ppe, 0, PPE_FLOW_CFG);
+
+	return read_poll_timeout(__raw_readl, val, !(val & PPE_GLO_CFG_BUSY),
+				 20, 100000, false, ppe->base + PPE_GLO_CFG);
+}
+
+struct en75_ppe *en75_ppe_init(struct device *dev, void __iomem *fe_base,
+			       struct net_device **netdev)
+{
+	struct en75_ppe *ppe;
+	int err;
+
+	ppe = devm_kzalloc(dev, sizeof(*ppe), GFP_KERNEL);
+	if (!ppe)
+		return ERR_PTR(-ENOMEM);
+
+	ppe->base = fe_base + PPE_BASE;
+	ppe->fe_base = fe_base;
+	ppe->netdev = netdev;
+
+	/* Zeroed, so every entry starts out FOE_STATE_INVALID */
+	ppe->foe_table = dmam_alloc_coherent(dev, PPE_ENTRIES *
+					     sizeof(*ppe->foe_table),
+					     &ppe->foe_phys, GFP_KERNEL);
+	ppe->foe_used = devm_bitmap_zalloc(dev, PPE_ENTRIES, GFP_KERNEL);
+	if (!ppe->foe_table || !ppe->foe_used)
+		return ERR_PTR(-ENOMEM);
+
+	err = rhashtable_init(&ppe->flows, &en75_flow_ht_params);
+	if (err)
+		return ERR_PTR(err);
+	mutex_init(&ppe->flow_lock);
+
+	return ppe;
+}
+
+static void en75_flow_free(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+void en75_ppe_deinit(struct en75_ppe *ppe)
+{
+	if (!ppe)
+		return;
+	rhashtable_free_and_destroy(&ppe->flows, en75_flow_free, NULL);
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+#ifndef ECONET_ETH_PPE_H
+#define ECONET_ETH_PPE_H
+
+#include <linux/netdevice.h>
+
+struct en75_ppe;
+
+/**
+ * en75_ppe_init - Set up the Packet Processing Engine of the frame engine
+ *
+ * @dev: The frame engine device, used for the DMA mapped flow table
+ * @fe_base: Frame engine registers
+ * @netdev: The MAC netdevs, indexed by MAC number, NUM_QDMA of them
+ *
+ * Returns: the PPE or an ERR_PTR, the hardware is left stopped
+ */
+struct en75_ppe *en75_ppe_init(struct device *dev, void __iomem *fe_base,
+			       struct net_device **netdev);
+void en75_ppe_deinit(struct en75_ppe *ppe);
+
+void en75_ppe_start(struct en75_ppe *ppe);
+int en75_ppe_stop(struct en75_ppe *ppe);
+
+/* TC_SETUP_BLOCK and TC_SETUP_FT for ndo_setup_tc */
+int en75_ppe_setup_tc(struct en75_ppe *ppe, struct net_device *dev,
+		      enum tc_setup_type type, void *type_data);
+
+#endif
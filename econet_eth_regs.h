@@ -4,6 +4,7 @@
 
 #include <linux/bits.h>
 #include <linux/bitfield.h>
+#include <linux/stddef.h>
 #include <linux/types.h>
 
 #ifndef FIELD_SET
@@ -103,6 +104,63 @@ enum qcfg_burst_size {
 
 
 
+/**
+ * qdma_delay_int_cfg - TX / RX Delay Interrupt Config
+ *
+ * There is one of these for TX done and one for RX done, they allow the
+ * hardware to hold back the done interrupt until either enough packets have
+ * completed or the oldest completion has waited long enough.
+ *
+ *      3                     2                   1                   0
+ *      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
+ *     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   0 |            unused_0           |E|   max_pint  |   max_ptime   |
+ *     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   4
+ *
+ * @bitfield_0 (32 bit):
+ *   @unused_0 (bits 31..16): Reserved
+ *   @en "E" (bit 15): Enable delayed interrupt, if disabled then every done
+ *                     event raises the interrupt immediately
+ *   @max_pint (bits 14..8): Raise the interrupt once this many packets are
+ *                           done
+ *   @max_ptime (bits 7..0): Raise the interrupt once the first done packet
+ *                           has waited this long, in units of 20us (same as
+ *                           the MediaTek frame engine)
+ */
+
+/* qdma_delay_int_cfg bitfield_0 */
+
+#define QDLY_EN						BIT(15)
+#define QDLY_MAX_PINT_MASK				GENMASK(14, 8)
+#define QDLY_MAX_PTIME_MASK				GENMASK(7, 0)
+
+#define QDLY_PTIME_UNIT_US				20
+
+/**
+ * qdma_rx_ring_cfg - RX ring sizes (also the layout of rx_ring_thr)
+ *
+ *      3                     2                   1                   0
+ *      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
+ *     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   0 |unused1|        ring1_size     |unused0|        ring0_size     |
+ *     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   4
+ *
+ * @bitfield_0 (32 bit):
+ *   @unused_1 (bits 31..28): Reserved
+ *   @ring1_size (bits 27..16): Number of descriptors in the chain 1 RX ring,
+ *                              assumed by analogy with ring0_size, the
+ *                              vendor driver only ever uses chain 0
+ *   @unused_0 (bits 15..12): Reserved
+ *   @ring0_size (bits 11..0): Number of descriptors in the chain 0 RX ring
+ */
+
+/* qdma_rx_ring_cfg bitfield_0 */
+
+#define QRXR_RING1_SIZE_MASK				GENMASK(27, 16)
+#define QRXR_RING0_SIZE_MASK				GENMASK(11, 0)
+
 /**
  * qring - QDMA Ring Registers
  * 
@@ -111,11 +169,11 @@ enum qcfg_burst_size {
  * @tx_cpui (32 bit): TX ring CPU (driver) index
  * @tx_hwi (32 bit): TX ring hardware index
  * @rx_cpui (32 bit): RX ring CPU (driver) index
- * @rx_hwi (32 bit): TX ring hardware index
+ * @rx_hwi (32 bit): RX ring hardware index
  */
 struct qchain_regs {
-        dma_addr_t txbase;
-        dma_addr_t rxbase;
+        u32 txbase;
+        u32 rxbase;
         u32 tx_cpui;
         u32 tx_hwi;
         u32 rx_cpui;
@@ -124,18 +182,57 @@ struct qchain_regs {
 
 /**
  * qregs - QDMA Global Registers
+ *
+ * @version (32 bit): Hardware version
+ * @cfg (32 bit): Global config, see qdma_cfg
+ * @qchain0 (192 bit): Ring registers for chain 0
+ * @hwfwd_dscp_base (32 bit): Hardware forwarding descriptor array address
+ * @hwfwd_buff_base (32 bit): Hardware forwarding buffer address
+ * @hwfwd_dscp_cfg (32 bit): Hardware forwarding payload size and threshold
+ * @lmgr_init_cfg (32 bit): Link manager init, number of hwfwd descriptors
+ * @int_status (32 bit): Interrupt status, write 1 to clear
+ * @int_mask (32 bit): Interrupt enable mask
+ * @tx_delay_int_cfg (32 bit): TX done interrupt moderation, see
+ *                             qdma_delay_int_cfg
+ * @rx_delay_int_cfg (32 bit): RX done interrupt moderation, see
+ *                             qdma_delay_int_cfg
+ * @irq_base (32 bit): TX Done List address
+ * @irq_cfg (32 bit): TX Done List depth
+ * @irq_clear_len (32 bit): Write N to give back N Done List entries
+ * @irq_status (32 bit): Done List head index and number of entries
+ * @rx_ring_cfg (32 bit): RX ring sizes, see qdma_rx_ring_cfg
+ * @rx_ring_thr (32 bit): RX ring low thresholds, see qdma_rx_ring_cfg
+ * @qchain1 (192 bit): Ring registers for chain 1
  */
 struct qregs {
 	u32 version;
 	u32 cfg;
 	struct qchain_regs qchain0;
-	u8 unused_0[232];
+	u32 hwfwd_dscp_base;
+	u32 hwfwd_buff_base;
+	u32 hwfwd_dscp_cfg;
+	u32 unused_0;
+	u32 lmgr_init_cfg;
+	u8 unused_1[28];
+	u32 int_status;
+	u32 int_mask;
+	u32 tx_delay_int_cfg;
+	u32 rx_delay_int_cfg;
+	u32 irq_base;
+	u32 irq_cfg;
+	u32 irq_clear_len;
+	u32 irq_status;
+	u8 unused_2[144];
+	u32 rx_ring_cfg;
+	u32 rx_ring_thr;
 	struct qchain_regs qchain1;
-	u8 unused_1[108];
+	u8 unused_3[108];
 	u32 end_word;
 };
 
 #endif /* ECONET_ETH_REGS_H */
 
 
-_Static_assert(sizeof(struct qregs) == 0x190, "qdma_regs size mismatch");
\ No newline at end of file
+_Static_assert(sizeof(struct qregs) == 0x190, "qdma_regs size mismatch");
+_Static_assert(offsetof(struct qregs, int_status) == 0x50, "qdma_regs int_status offset");
+_Static_assert(offsetof(struct qregs, rx_ring_cfg) == 0x100, "qdma_regs rx_ring_cfg offset");
@@ -222,6 +222,9 @@ struct qdma_desc_erx {
 #define ERX_SPORT_MASK					GENMASK(22, 19)
 #define ERX_CRSN_MASK					GENMASK(18, 14)
 #define ERX_PPE_ENTRY_MASK				GENMASK(13, 0)
+/* ppe_entry of a packet which the PPE did not hash, as on MediaTek */
+#define ERX_PPE_ENTRY_NONE				0x3fff
+#define ERX_CRSN_COUNT					32
 
 static inline u8 get_erx_unknown1(struct qdma_desc_erx *x) {
 	return FIELD_GET(ERX_UNKNOWN1_MASK, x->bitfield_0);
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0-only
+#ifndef QDMA_RING_H
+#define QDMA_RING_H
+
+#include <linux/bug.h>
+#include <linux/log2.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "qdma_desc.h"
+
+/**
+ * qdma_ring - Producer/consumer accounting for one QDMA descriptor ring
+ *
+ * This only touches the descriptor array, never the registers, so the
+ * accounting can be exercised against a plain array of struct qdma_desc.
+ *
+ * The hardware owns the descriptors from @tail up to (but not including)
+ * @head, the driver owns the rest. @head is what gets written to the CPU
+ * index register. One slot is always left empty so that a full ring and an
+ * empty ring can be told apart, the hardware can't see the difference
+ * between CPU index == DMA index meaning "everything" and "nothing".
+ *
+ * @descs: Descriptor array, shared with the hardware
+ * @size: Number of descriptors, must be a power of two and no more than
+ *        the 12 bits which fit in next_idx
+ * @head: Next descriptor that the driver will hand to the hardware
+ * @tail: Oldest descriptor which the hardware has not yet given back
+ */
+struct qdma_ring {
+	struct qdma_desc *descs;
+	u16 size;
+	u16 head;
+	u16 tail;
+};
+
+static inline u16 qdma_ring_next(struct qdma_ring *r, u16 idx) {
+	return (idx + 1) & (r->size - 1);
+}
+static inline u16 qdma_ring_used(struct qdma_ring *r) {
+	return (r->head - r->tail) & (r->size - 1);
+}
+static inline u16 qdma_ring_free(struct qdma_ring *r) {
+	return r->size - 1 - qdma_ring_used(r);
+}
+static inline struct qdma_desc *qdma_ring_desc(struct qdma_ring *r, u16 idx) {
+	return &r->descs[idx];
+}
+
+/**
+ * qdma_ring_init - Clear the descriptors and link them into a circle
+ *
+ * @r: The ring
+ * @descs: Descriptor array, @size entries long
+ * @size: Number of descriptors, a power of two
+ */
+static inline void qdma_ring_init(struct qdma_ring *r, struct qdma_desc *descs,
+				  u16 size)
+{
+	u16 i;
+
+	WARN_ON(!is_power_of_2(size) || size > DESC_NEXT_IDX_MASK + 1);
+
+	r->descs = descs;
+	r->size = size;
+	r->head = 0;
+	r->tail = 0;
+
+	memset(descs, 0, sizeof(*descs) * size);
+	for (i = 0; i < size; i++)
+		set_desc_next_idx(&descs[i], qdma_ring_next(r, i));
+}
+
+/**
+ * qdma_ring_push - Claim the descriptor at head for the hardware
+ *
+ * The caller must have checked qdma_ring_free() and must finish writing the
+ * descriptor before the new head is written to the CPU index register.
+ *
+ * Returns: the index of the claimed descriptor
+ */
+static inline u16 qdma_ring_push(struct qdma_ring *r) {
+	u16 idx = r->head;
+
+	r->head = qdma_ring_next(r, idx);
+	return idx;
+}
+
+/**
+ * qdma_ring_tail_done - Check whether the hardware gave back the tail
+ *
+ * Returns: true if the ring is not empty and the oldest descriptor has
+ *          been marked done by the hardware.
+ */
+static inline bool qdma_ring_tail_done(struct qdma_ring *r) {
+	return qdma_ring_used(r) && is_desc_done(qdma_ring_desc(r, r->tail));
+}
+
+/**
+ * qdma_ring_pop - Take back the descriptor at tail
+ *
+ * The caller must have checked qdma_ring_tail_done() or otherwise know that
+ * the hardware is finished with the descriptor.
+ *
+ * Returns: the index of the descriptor which was taken back
+ */
+static inline u16 qdma_ring_pop(struct qdma_ring *r) {
+	u16 idx = r->tail;
+
+	r->tail = qdma_ring_next(r, idx);
+	return idx;
+}
+
+#endif /* QDMA_RING_H */
@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests for the ring accounting in qdma_ring.h, run against a plain
+ * array of descriptors.
+ */
+#include <kunit/test.h>
+
+#include "qdma_ring.h"
+
+#define TEST_RING_SIZE	8
+
+static struct qdma_ring *qdma_ring_test_alloc(struct kunit *test, u16 size)
+{
+	struct qdma_ring *r;
+	struct qdma_desc *descs;
+
+	r = kunit_kzalloc(test, sizeof(*r), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, r);
+	descs = kunit_kcalloc(test, size, sizeof(*descs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, descs);
+
+	qdma_ring_init(r, descs, size);
+	return r;
+}
+
+static void qdma_ring_test_empty(struct kunit *test)
+{
+	struct qdma_ring *r = qdma_ring_test_alloc(test, TEST_RING_SIZE);
+
+	KUNIT_EXPECT_EQ(test, qdma_ring_used(r), 0);
+	KUNIT_EXPECT_EQ(test, qdma_ring_free(r), TEST_RING_SIZE - 1);
+	KUNIT_EXPECT_FALSE(test, qdma_ring_tail_done(r));
+
+	/* A done bit on a descriptor the hardware doesn't own means nothing */
+	set_desc_done(qdma_ring_desc(r, r->tail), true);
+	KUNIT_EXPECT_FALSE(test, qdma_ring_tail_done(r));
+}
+
+/* One slot always stays empty, a full ring has size - 1 in use */
+static void qdma_ring_test_full(struct kunit *test)
+{
+	struct qdma_ring *r = qdma_ring_test_alloc(test, TEST_RING_SIZE);
+	int i;
+
+	for (i = 0; i < TEST_RING_SIZE - 1; i++) {
+		KUNIT_EXPECT_EQ(test, qdma_ring_push(r), i);
+		KUNIT_EXPECT_EQ(test, qdma_ring_used(r), i + 1);
+		KUNIT_EXPECT_EQ(test, qdma_ring_free(r),
+				TEST_RING_SIZE - 2 - i);
+	}
+
+	KUNIT_EXPECT_EQ(test, qdma_ring_used(r), TEST_RING_SIZE - 1);
+	KUNIT_EXPECT_EQ(test, qdma_ring_free(r), 0);
+	KUNIT_EXPECT_EQ(test, qdma_ring_next(r, r->head), r->tail);
+
+	for (i = 0; i < TEST_RING_SIZE - 1; i++) {
+		set_desc_done(qdma_ring_desc(r, r->tail), true);
+		KUNIT_EXPECT_TRUE(test, qdma_ring_tail_done(r));
+		KUNIT_EXPECT_EQ(test, qdma_ring_pop(r), i);
+	}
+
+	KUNIT_EXPECT_EQ(test, qdma_ring_used(r), 0);
+	KUNIT_EXPECT_EQ(test, qdma_ring_free(r), TEST_RING_SIZE - 1);
+}
+
+/* Head and tail go round the ring several times */
+static void qdma_ring_test_wrap(struct kunit *test)
+{
+	struct qdma_ring *r = qdma_ring_test_alloc(test, TEST_RING_SIZE);
+	u16 expect_head = 0, expect_tail = 0;
+	int i;
+
+	/* Keep 3 in flight so used wraps past the end of the array */
+	for (i = 0; i < 3; i++)
+		KUNIT_EXPECT_EQ(test, qdma_ring_push(r), expect_head++);
+
+	for (i = 0; i < 4 * TEST_RING_SIZE; i++) {
+		KUNIT_EXPECT_EQ(test, qdma_ring_push(r),
+				expect_head % TEST_RING_SIZE);
+		expect_head++;
+		KUNIT_EXPECT_EQ(test, qdma_ring_pop(r),
+				expect_tail % TEST_RING_SIZE);
+		expect_tail++;
+
+		KUNIT_EXPECT_EQ(test, qdma_ring_used(r), 3);
+		KUNIT_EXPECT_EQ(test, qdma_ring_free(r), TEST_RING_SIZE - 4);
+	}
+
+	KUNIT_EXPECT_EQ(test, r->head, expect_head % TEST_RING_SIZE);
+	KUNIT_EXPECT_EQ(test, r->tail, expect_tail % TEST_RING_SIZE);
+}
+
+/* The tail only counts as done once the hardware set the bit on it */
+static void qdma_ring_test_tail_done(struct kunit *test)
+{
+	struct qdma_ring *r = qdma_ring_test_alloc(test, TEST_RING_SIZE);
+
+	qdma_ring_push(r);
+	qdma_ring_push(r);
+	KUNIT_EXPECT_FALSE(test, qdma_ring_tail_done(r));
+
+	/* Done on the newer descriptor says nothing about the tail */
+	set_desc_done(qdma_ring_desc(r, 1), true);
+	KUNIT_EXPECT_FALSE(test, qdma_ring_tail_done(r));
+
+	set_desc_done(qdma_ring_desc(r, 0), true);
+	KUNIT_EXPECT_TRUE(test, qdma_ring_tail_done(r));
+	qdma_ring_pop(r);
+	KUNIT_EXPECT_TRUE(test, qdma_ring_tail_done(r));
+	qdma_ring_pop(r);
+	KUNIT_EXPECT_FALSE(test, qdma_ring_tail_done(r));
+}
+
+/* The descriptors link into a circle, up to the 12 bits of next_idx */
+static void qdma_ring_test_next_idx(struct kunit *test)
+{
+	u16 size = DESC_NEXT_IDX_MASK + 1;
+	struct qdma_ring *r = qdma_ring_test_alloc(test, size);
+	int i;
+
+	KUNIT_EXPECT_EQ(test, size, 4096);
+	for (i = 0; i < size; i++)
+		KUNIT_EXPECT_EQ(test, get_desc_next_idx(qdma_ring_desc(r, i)),
+				(i + 1) % size);
+
+	KUNIT_EXPECT_EQ(test, qdma_ring_free(r), size - 1);
+	r->head = size - 1;
+	KUNIT_EXPECT_EQ(test, qdma_ring_used(r), size - 1);
+	KUNIT_EXPECT_EQ(test, qdma_ring_free(r), 0);
+	KUNIT_EXPECT_EQ(test, qdma_ring_next(r, size - 1), 0);
+}
+
+static struct kunit_case qdma_ring_test_cases[] = {
+	KUNIT_CASE(qdma_ring_test_empty),
+	KUNIT_CASE(qdma_ring_test_full),
+	KUNIT_CASE(qdma_ring_test_wrap),
+	KUNIT_CASE(qdma_ring_test_tail_done),
+	KUNIT_CASE(qdma_ring_test_next_idx),
+	{}
+};
+
+static struct kunit_suite qdma_ring_test_suite = {
+	.name = "econet-qdma-ring",
+	.test_cases = qdma_ring_test_cases,
+};
+
+kunit_test_suite(qdma_ring_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests for the EcoNet QDMA ring accounting");
+MODULE_LICENSE("GPL");